@@ -1,70 +1,33 @@
 #ifndef ALARMS_H
 
 #define ALARMS_H
-#define buzzerPin D7
-#define NOTE_BASE 4000
-
-void millisDelay(int t){
-  unsigned long temp = millis();
-  while(millis() - temp < (unsigned long)t && digitalRead(SW)) {
-  }
-  return;
-}
 
-void note(int note, int duration = 200, int pause = 20){
-  tone(buzzerPin, NOTE_BASE + 500 * note, duration);
-  millisDelay(duration + pause);
-}
+#include <functional>
 
-void defaultAlarm(){
-  tone(buzzerPin, 5000, 1000);
-  millisDelay(1200);
-}
+#include "stall.h"
+#include "audio.h"
+#include "melodies.h"
 
-void rapidFireAlarm(){
-  tone(buzzerPin, 5000, 90);
-  millisDelay(100);
-}
+#define buzzerPin D7
 
-void unevenAlarm(){
-  tone(buzzerPin, 5000, 300);
-  millisDelay(400);
-  tone(buzzerPin, 500, 700);
-  millisDelay(800);
+void startAlarmSound(){
+  audioSynth.setGainRamp(ALARM_GAIN_START, 255, ALARM_RAMP_MILLIS);
+  audioBegin(buzzerPin);
 }
 
-void scaleAlarm(){
-  for(int i = 0; i < 10; i++){
-    tone(buzzerPin, 500 * i, 200);
-    millisDelay(220);
-  }
-  for(int i = 9; i >= 0; i--){
-    tone(buzzerPin, 500 * i, 200);
-    millisDelay(220);
+// Plays the melody once, stops early when keepRinging returns false.
+// Ringing until the alarm is dismissed is expected, so it doesn't count as a stall
+void playMelody(const SynthMelody& melody, const std::function<bool()>& keepRinging){
+  audioSynth.play(melody);
+  while(audioSynth.isPlaying() && keepRinging()){
+    audioLoop();
+    yield();
+    stallHeartbeat();
   }
 }
 
-void doubleToneAlarm(){
-  tone(buzzerPin, 5000, 200);
-  millisDelay(240);
-  tone(buzzerPin, 5000, 200);
-  millisDelay(500);
-}
-
-void complexPresents(){
-  note(-3);
-  note(0, 200, 40);
-  note(0);
-  note(1);
-  note(2);
-  note(0);
-  note(2);
-  note(3);
-  note(4, 200, 40);
-  note(4);
-  note(3);
-  note(2);
+void stopAlarmSound(){
+  audioEnd();
 }
 
-void (*alarmArray[])(void) = { &defaultAlarm, &rapidFireAlarm, &unevenAlarm, &scaleAlarm, &doubleToneAlarm, &complexPresents };
-#endif
\ No newline at end of file
+#endif
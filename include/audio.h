@@ -0,0 +1,97 @@
+#ifndef AUDIO_H
+
+#define AUDIO_H
+
+#include <Arduino.h>
+#include <sigma_delta.h>
+
+#include "log.h"
+#include "synth.h"
+
+/*
+  Output of the synthesizer on the buzzer pin
+
+  The I2S data output of the ESP8266 is on GPIO3 (RX), not on the buzzer pin, so the
+  samples go to the sigma-delta modulator, that can be routed to any pin. A timer1 interrupt
+  copies a sample every 1/SYNTH_SAMPLE_RATE seconds from one of two buffers into the
+  modulator, while audioLoop() renders the other one from the main loop.
+  When a buffer isn't ready in time the output stays at the middle level and the
+  missing samples are counted in audioUnderruns.
+*/
+
+#define AUDIO_BUFFER 512
+#define AUDIO_RENDER_CHUNK 64
+#define AUDIO_SILENCE 128
+#define AUDIO_TIMER_CLOCK 80000000UL    // timer1 counts at 80MHz with TIM_DIV1
+
+Synth audioSynth;
+uint8_t audioBuffers[2][AUDIO_BUFFER];
+volatile bool audioReady[2] = { false, false };
+volatile uint8_t audioCurrent = 0;
+volatile uint16_t audioPosition = 0;
+volatile unsigned long audioUnderruns = 0;
+int audioPin = -1;
+
+IRAM_ATTR void audioISR(){
+  if(audioPosition == AUDIO_BUFFER){
+    audioReady[audioCurrent] = false;
+    audioCurrent ^= 1;
+    audioPosition = 0;
+  }
+  uint8_t sample = AUDIO_SILENCE;
+  if(audioReady[audioCurrent]){
+    sample = audioBuffers[audioCurrent][audioPosition++];
+  }else{
+    audioUnderruns++;
+  }
+  GPSD = (GPSD & ~(0xFF << GPSDT)) | (sample << GPSDT);
+}
+
+// Renders the buffers that were already played, must be called often while the sound is on
+void audioLoop(){
+  int16_t chunk[AUDIO_RENDER_CHUNK];
+  for(int b = 0; b < 2; b++){
+    if(audioReady[b]){
+      continue;
+    }
+    for(int i = 0; i < AUDIO_BUFFER; i += AUDIO_RENDER_CHUNK){
+      audioSynth.render(chunk, AUDIO_RENDER_CHUNK);
+      for(int j = 0; j < AUDIO_RENDER_CHUNK; j++){
+        audioBuffers[b][i + j] = (chunk[j] >> 8) + AUDIO_SILENCE;
+      }
+    }
+    // The samples must be in the buffer before the interrupt sees it as ready
+    asm volatile("" ::: "memory");
+    audioReady[b] = true;
+  }
+}
+
+void audioBegin(int pin){
+  audioPin = pin;
+  audioReady[0] = audioReady[1] = false;
+  audioCurrent = 0;
+  audioPosition = 0;
+  audioUnderruns = 0;
+  audioLoop();
+
+  sigmaDeltaSetup(0, 312500);
+  sigmaDeltaAttachPin(pin, 0);
+  timer1_attachInterrupt(audioISR);
+  timer1_enable(TIM_DIV1, TIM_EDGE, TIM_LOOP);
+  timer1_write(AUDIO_TIMER_CLOCK / SYNTH_SAMPLE_RATE);
+}
+
+void audioEnd(){
+  timer1_disable();
+  timer1_detachInterrupt();
+  audioSynth.stop();
+  if(audioPin >= 0){
+    sigmaDeltaDetachPin(audioPin);
+    digitalWrite(audioPin, LOW);
+  }
+  if(audioUnderruns > 0){
+    LOG_WARN("Audio underruns: %lu samples\n", audioUnderruns);
+  }
+}
+
+#endif
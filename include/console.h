@@ -0,0 +1,162 @@
+#ifndef CONSOLE_H
+
+#define CONSOLE_H
+
+#include <Arduino.h>
+#include <functional>
+
+#include "log.h"
+
+/*
+  Line oriented command console on the serial port, to configure a clock without LCD and encoder
+
+  consoleLoop() only reads the bytes already in the UART buffer and runs at most one command per
+  call, so it never waits for the rest of a line. A line is a command and its arguments separated
+  by spaces, arguments with spaces go between double quotes.
+  Every command answers with its output and then "OK" or "ERR <usage>", so a script can send a
+  line and wait for one of the two. The commands print to consoleOutput, that is Serial unless
+  the line came from another channel, like the MQTT cmd topic.
+
+  "begin" starts a batch: the commands change the settings in RAM and "commit" saves them all
+  with one flash write.
+*/
+
+#define CONSOLE_LINE_L 128
+#define CONSOLE_MAX_ARGS 8
+#define CONSOLE_MAX_COMMANDS 24
+
+typedef std::function<bool(int argc, char** argv)> ConsoleHandler;
+
+struct ConsoleCommand {
+  const char* name;
+  const char* usage;
+  ConsoleHandler handler;
+};
+
+ConsoleCommand consoleCommands[CONSOLE_MAX_COMMANDS];
+int consoleCommandCount = 0;
+char consoleLine[CONSOLE_LINE_L];
+size_t consoleLength = 0;
+bool consoleOverflow = false;
+bool consoleBatch = false;
+std::function<bool()> consoleCommitFunc;
+Print* consoleOutput = &Serial;
+
+void consoleCommand(const char* name, const char* usage, const ConsoleHandler& handler){
+  if(consoleCommandCount < CONSOLE_MAX_COMMANDS){
+    consoleCommands[consoleCommandCount++] = { name, usage, handler };
+  }
+}
+
+// Splits the line in place, returns the number of arguments
+int splitConsoleLine(char* line, char** argv){
+  int argc = 0;
+  char* p = line;
+  while(*p && argc < CONSOLE_MAX_ARGS){
+    while(*p == ' ' || *p == '\t'){
+      p++;
+    }
+    if(!*p){
+      break;
+    }
+    char end = ' ';
+    if(*p == '"'){
+      end = '"';
+      p++;
+    }
+    argv[argc++] = p;
+    while(*p && *p != end && (end == '"' || *p != '\t')){
+      p++;
+    }
+    if(*p){
+      *p++ = '\0';
+    }
+  }
+  return argc;
+}
+
+bool runConsoleCommand(char* line){
+  char* argv[CONSOLE_MAX_ARGS];
+  int argc = splitConsoleLine(line, argv);
+  if(argc == 0){
+    return false;
+  }
+
+  if(strcmp(argv[0], "help") == 0){
+    consoleOutput->println("begin");
+    consoleOutput->println("commit");
+    for(int i = 0; i < consoleCommandCount; i++){
+      consoleOutput->printf("%s %s\n", consoleCommands[i].name, consoleCommands[i].usage);
+    }
+    consoleOutput->println("OK");
+    return true;
+  }
+  if(strcmp(argv[0], "begin") == 0){
+    consoleBatch = true;
+    consoleOutput->println("OK");
+    return true;
+  }
+  if(strcmp(argv[0], "commit") == 0){
+    bool committed = consoleBatch && consoleCommitFunc();
+    consoleBatch = false;
+    consoleOutput->println(committed ? "OK" : "ERR not in a batch or save failed");
+    return committed;
+  }
+
+  for(int i = 0; i < consoleCommandCount; i++){
+    if(strcmp(argv[0], consoleCommands[i].name) == 0){
+      if(consoleCommands[i].handler(argc - 1, argv + 1)){
+        consoleOutput->println("OK");
+        return true;
+      }
+      consoleOutput->printf("ERR %s %s\n", consoleCommands[i].name, consoleCommands[i].usage);
+      return false;
+    }
+  }
+  consoleOutput->println("ERR unknown command, try help");
+  return false;
+}
+
+// Runs a line in place with its output on output, returns true if the command succeeded.
+// The MQTT cmd topic uses it too.
+bool runConsoleLine(char* line, Print& output = Serial){
+  consoleOutput = &output;
+  bool ok = runConsoleCommand(line);
+  consoleOutput = &Serial;
+  return ok;
+}
+
+void consoleLoop(){
+  while(Serial.available() > 0){
+    char c = Serial.read();
+    if(c == '\r'){
+      continue;
+    }
+    if(c != '\n'){
+      if(consoleLength < CONSOLE_LINE_L - 1){
+        consoleLine[consoleLength++] = c;
+      }else{
+        consoleOverflow = true;
+      }
+      continue;
+    }
+
+    consoleLine[consoleLength] = '\0';
+    logFlush();     // The output goes straight to Serial, it must not cut a log message
+    if(consoleOverflow){
+      Serial.println("ERR line too long");
+    }else{
+      runConsoleLine(consoleLine);
+    }
+    consoleLength = 0;
+    consoleOverflow = false;
+    return;       // One command per loop cycle, the rest of the buffer waits for the next one
+  }
+}
+
+// commitFunc saves every setting, it's called at the end of a batch
+void setupConsole(const std::function<bool()>& commitFunc){
+  consoleCommitFunc = commitFunc;
+}
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef DEADLINE_H
+
+#define DEADLINE_H
+
+#include <Arduino.h>
+#include <Ticker.h>
+#include <StreamString.h>
+#include <functional>
+#include <time.h>
+
+#include "webserver.h"
+
+/*
+  Alarm deadlines
+
+  The next alarm is kept as the absolute time (in seconds since 1970 of the clock on the
+  display) when it must ring. The loop fires the alarm as soon as it sees the deadline passed,
+  so a loop blocked during the alarm minute or a sync that corrects the clock over it only make
+  the alarm late. A step bigger than ALARM_GRACE_SECONDS (the first sync after the time was set
+  by hand) isn't lateness: setLocalTime() searches the deadline again from the new time. A Ticker armed for the deadline sets alarmTimerExpired, that the long waits (the WiFi
+  retries) check to give up and let the alarm ring.
+  An alarm later than ALARM_GRACE_SECONDS is logged as missed instead of ringing, and the next
+  deadline is searched from the one just handled, so every alarm in between is handled too.
+  A snoozed alarm is a deadline that isn't in the weekly alarms, a change to the alarms
+  cancels it.
+
+  The lateness of the alarms that rang is kept in a histogram with power of two buckets
+  in milliseconds, shown with GET /alarm.
+*/
+
+#ifndef ALARM_GRACE_SECONDS
+#define ALARM_GRACE_SECONDS 600
+#endif
+#define ALARM_TIMER_MAX 3600000UL      // The Ticker can't wait much more than an hour
+#define LATENESS_BUCKETS 20
+
+Ticker alarmTicker;
+volatile bool alarmTimerExpired = false;
+uint32_t alarmDeadline = 0;           // 0 if there is no alarm
+bool alarmDeadlineTemporary = false;
+bool alarmDeadlineSnooze = false;
+bool alarmScheduleChanged = true;     // The alarms changed, the deadline must be searched again
+uint32_t alarmLateness[LATENESS_BUCKETS];
+uint32_t alarmsMissed = 0;
+std::function<uint64_t()> deadlineGetTime;
+
+// First alarm strictly after "after", 0 if there is none.
+// The temporary alarm replaces the weekly alarm of its day of the week.
+uint32_t nextAlarmTime(uint32_t after, const uint8_t alarmTimes[7][2], const uint8_t nextAlarm[2], int nextDay, bool& temporary){
+  uint32_t today = after / 86400;
+  for(uint32_t i = 0; i <= 7; i++){
+    uint32_t dayStart = (today + i) * 86400;
+    int weekDay = (today + i + 4) % 7;    // 1/1/1970 was a thursday
+    const uint8_t* time = weekDay == nextDay ? nextAlarm : alarmTimes[weekDay];
+    if(time[0] == 255){
+      continue;
+    }
+    uint32_t candidate = dayStart + time[0] * 3600 + time[1] * 60;
+    if(candidate > after){
+      temporary = weekDay == nextDay;
+      return candidate;
+    }
+  }
+  return 0;
+}
+
+void alarmTimerCallback(){
+  alarmTimerExpired = true;
+}
+
+// Arms the Ticker for the deadline, again when the time of the clock changes
+void armAlarmTimer(){
+  alarmTicker.detach();
+  alarmTimerExpired = false;
+  uint64_t now = deadlineGetTime ? deadlineGetTime() : 0;
+  if(alarmDeadline == 0 || now == 0){
+    return;
+  }
+  uint64_t deadline = (uint64_t)alarmDeadline * 1000;
+  if(deadline <= now){
+    alarmTimerExpired = true;
+    return;
+  }
+  // Farther deadlines wake the loop early, and it arms the timer again
+  uint64_t wait = deadline - now;
+  alarmTicker.once_ms(wait < ALARM_TIMER_MAX ? wait : ALARM_TIMER_MAX, alarmTimerCallback);
+}
+
+void scheduleAlarm(uint32_t deadline, bool temporary){
+  alarmDeadline = deadline;
+  alarmDeadlineTemporary = temporary;
+  alarmDeadlineSnooze = false;
+  alarmScheduleChanged = false;
+  armAlarmTimer();
+}
+
+void snoozeAlarm(uint32_t deadline){
+  scheduleAlarm(deadline, false);
+  alarmDeadlineSnooze = true;
+}
+
+// Returns how late the deadline is in milliseconds, -1 if it didn't come yet
+int64_t alarmDeadlineLateness(){
+  if(alarmDeadline == 0){
+    return -1;
+  }
+  uint64_t now = deadlineGetTime();
+  uint64_t deadline = (uint64_t)alarmDeadline * 1000;
+  if(now < deadline){
+    if(alarmTimerExpired){
+      armAlarmTimer();    // Woken early for a deadline farther than the Ticker can wait
+    }
+    return -1;
+  }
+  return now - deadline;
+}
+
+void recordAlarmLateness(uint32_t lateness){
+  int bucket = lateness == 0 ? 0 : 32 - __builtin_clz(lateness);
+  alarmLateness[bucket < LATENESS_BUCKETS ? bucket : LATENESS_BUCKETS - 1]++;
+}
+
+void handleAlarmStatus(){
+  StreamString text;
+  if(alarmDeadline != 0){
+    time_t deadline = alarmDeadline;
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M", gmtime(&deadline));
+    text.printf("Next alarm: %s%s\n", buffer, alarmDeadlineTemporary ? " (temporary)" : (alarmDeadlineSnooze ? " (snoozed)" : ""));
+  }else{
+    text.print("No alarm\n");
+  }
+  text.printf("Missed: %u\nLateness:\n", alarmsMissed);
+  for(int i = 0; i < LATENESS_BUCKETS; i++){
+    if(alarmLateness[i] > 0){
+      text.printf("%s %lu ms: %u\n", i < LATENESS_BUCKETS - 1 ? "<" : ">=", 1UL << (i < LATENESS_BUCKETS - 1 ? i : i - 1), alarmLateness[i]);
+    }
+  }
+  server.send(200, "text/plain", text);
+}
+
+// getTime returns the milliseconds since 1970 of the clock on the display, 0 if it isn't known
+void setupAlarmDeadlines(const std::function<uint64_t()>& getTime){
+  deadlineGetTime = getTime;
+  memset(alarmLateness, 0, sizeof(alarmLateness));
+  server.on("/alarm", HTTP_GET, withAuthentication(handleAlarmStatus));
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef DISCOVERY_H
+
+#define DISCOVERY_H
+
+#include <Arduino.h>
+#include <ESP8266mDNS.h>
+
+#include "log.h"
+
+/*
+  DNS-SD advertisement, to find every clock of a network with one query
+
+  The clock answers as espsveglia.local, or espsveglia-<chip id>.local when another clock has
+  the name already, and registers the service "_sveglia._tcp" on the HTTPS port with the
+  instance name "Sveglia <chip id>". The TXT record carries the state of the clock:
+  txtvers  1
+  id       chip id
+  fw       firmware version
+  next     next alarm, "YYYY-MM-DD HH:MM" with " skip" when it won't ring, or "none"
+  sync     where the time comes from: "ntp", "fleet", "browser", "manual", "stale" or "none"
+  cfg      config version of the alarms
+  setDiscoveryState() can be called often: only a change rewrites the TXT record and
+  announces it, so the caches of the other hosts are refreshed without polling the clocks.
+
+  tools/sveglia_discover.cpp lists the clocks with their state.
+*/
+
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION __DATE__ " " __TIME__    // -DFIRMWARE_VERSION=\"...\" in the build flags to name a release
+#endif
+#define DISCOVERY_HOSTNAME "espsveglia"
+#define DISCOVERY_PORT 443
+#define DISCOVERY_NEXT_L 24
+#define DISCOVERY_SYNC_L 8
+
+bool discoveryStarted = false;
+MDNSResponder::hMDNSService discoveryService = nullptr;
+char discoveryNext[DISCOVERY_NEXT_L] = "none";
+char discoverySync[DISCOVERY_SYNC_L] = "none";
+uint32_t discoveryConfig = 0;
+
+void setDiscoveryTxt(){
+  MDNS.removeServiceTxt(discoveryService, "next");
+  MDNS.removeServiceTxt(discoveryService, "sync");
+  MDNS.removeServiceTxt(discoveryService, "cfg");
+  MDNS.addServiceTxt(discoveryService, "next", discoveryNext);
+  MDNS.addServiceTxt(discoveryService, "sync", discoverySync);
+  MDNS.addServiceTxt(discoveryService, "cfg", discoveryConfig);
+}
+
+void setDiscoveryState(const char* next, const char* sync, uint32_t configVersion){
+  if(strcmp(next, discoveryNext) == 0 && strcmp(sync, discoverySync) == 0 && configVersion == discoveryConfig){
+    return;
+  }
+  strncpy(discoveryNext, next, DISCOVERY_NEXT_L - 1);
+  strncpy(discoverySync, sync, DISCOVERY_SYNC_L - 1);
+  discoveryConfig = configVersion;
+  if(discoveryStarted){
+    setDiscoveryTxt();
+    MDNS.announce();
+  }
+}
+
+// Once the station is connected, the responder follows the reconnections by itself
+void startDiscovery(){
+  if(discoveryStarted){
+    return;
+  }
+  MDNS.setHostProbeResultCallback([](const char* hostname, bool unique){
+    if(!unique){
+      char fallback[32];
+      snprintf(fallback, sizeof(fallback), DISCOVERY_HOSTNAME "-%08x", ESP.getChipId());
+      LOG_WARN("%s.local is taken, using %s.local\n", hostname, fallback);
+      MDNS.setHostname(fallback);
+    }
+  });
+  if(!MDNS.begin(DISCOVERY_HOSTNAME)){
+    LOG_ERROR("Error setting up MDNS responder!\n");
+    return;
+  }
+
+  char instance[24];
+  char id[12];
+  snprintf(instance, sizeof(instance), "Sveglia %08x", ESP.getChipId());
+  snprintf(id, sizeof(id), "%08x", ESP.getChipId());
+  discoveryService = MDNS.addService(instance, "sveglia", "tcp", DISCOVERY_PORT);
+  if(!discoveryService){
+    LOG_ERROR("Error adding the MDNS service\n");
+    return;
+  }
+  MDNS.addServiceTxt(discoveryService, "txtvers", "1");
+  MDNS.addServiceTxt(discoveryService, "id", id);
+  MDNS.addServiceTxt(discoveryService, "fw", FIRMWARE_VERSION);
+  setDiscoveryTxt();
+  discoveryStarted = true;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef ENCODER_H
+
+#define ENCODER_H
+
+#include <stdint.h>
+
+/*
+  Acceleration of the encoder when entering a value
+
+  The faster the encoder turns, the more a detent moves the value: a profile lists the speeds
+  from the fastest, each one with the longest time between two detents in the same direction
+  and how many units it moves. Slower detents, and the first one after a change of direction,
+  move by one unit. A jump of more than one unit lands on a multiple of its size, so a fast
+  spin goes through 0, 15, 30, 45 and the last units are set turning slowly.
+
+  This file must not depend on Arduino, the host tool in tools/ includes it too.
+*/
+
+struct EncoderSpeed {
+  uint16_t maxInterval;   // Milliseconds
+  uint8_t units;
+};
+
+struct EncoderProfile {
+  const EncoderSpeed* speeds;
+  uint8_t count;
+};
+
+const EncoderSpeed hourSpeeds[] = { { 40, 3 } };
+const EncoderSpeed minuteSpeeds[] = { { 35, 15 }, { 60, 10 }, { 100, 5 } };
+const EncoderProfile hourProfile = { hourSpeeds, 1 };
+const EncoderProfile minuteProfile = { minuteSpeeds, 3 };
+
+class EncoderAccelerator {
+public:
+  EncoderAccelerator(const EncoderProfile& profile) : profile(profile), lastTime(0), lastDirection(0) {}
+
+  // direction is 1 or -1, returns how much the value moves
+  int step(uint32_t time, int direction){
+    int units = 1;
+    if(direction == lastDirection){
+      uint32_t interval = time - lastTime;
+      for(int i = 0; i < profile.count; i++){
+        if(interval < profile.speeds[i].maxInterval){
+          units = profile.speeds[i].units;
+          break;
+        }
+      }
+    }
+    lastTime = time;
+    lastDirection = direction;
+    return units * direction;
+  }
+
+private:
+  const EncoderProfile& profile;
+  uint32_t lastTime;
+  int lastDirection;
+};
+
+int positiveModulo(int value, int divisor){
+  return ((value % divisor) + divisor) % divisor;
+}
+
+// Moves the value by step in [0, range), the units of the profile must divide range
+int applyEncoderStep(int value, int step, int range){
+  int next = value + step;
+  if(step > 1){
+    next -= positiveModulo(next, step);
+  }else if(step < -1 && positiveModulo(next, -step) != 0){
+    next += -step - positiveModulo(next, -step);
+  }
+  return positiveModulo(next, range);
+}
+
+#endif
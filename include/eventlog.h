@@ -0,0 +1,190 @@
+#ifndef EVENTLOG_H
+
+#define EVENTLOG_H
+
+#include <Arduino.h>
+#include <flash_hal.h>
+#include <functional>
+
+#include "log.h"
+#include "webserver.h"
+
+/*
+  Persistent event log, to know what happened when an alarm didn't ring
+
+  The records are kept in a ring of flash sectors at the start of the filesystem area,
+  which isn't used by the firmware. New records go to a RAM staging buffer that is
+  written to flash when it's full or once a minute, and a sector is only erased when
+  the ring wraps onto it.
+
+  GET /log streams the records from the oldest, reading them from flash a few at a time.
+*/
+
+enum EventType : uint16_t {
+  EVENT_RESET,              // value: reset reason
+  EVENT_ALARM_FIRED,        // value: alarm sound
+  EVENT_ALARM_DISMISSED,    // value: milliseconds before it was dismissed
+  EVENT_ALARM_SKIPPED,      // value: 1 if the day is in the holiday calendar
+  EVENT_NTP_SYNC,           // value: correction in milliseconds, extra: retries
+  EVENT_WIFI_CONNECTED,     // value: RSSI
+  EVENT_WIFI_FAILED,
+  EVENT_WIFI_DISCONNECTED,  // value: reason
+  EVENT_CONFIG_CHANGED,     // value: ConfigChange
+  EVENT_TIME_SET,           // value: round trip time of the browser in milliseconds
+  EVENT_STALL,              // value: PC, extra: StallSection
+  EVENT_ALARM_MISSED,       // value: seconds after the deadline
+  EVENT_TYPE_COUNT
+};
+
+enum ConfigChange : int32_t {
+  CONFIG_ALARMS,
+  CONFIG_SOUND,
+  CONFIG_NETWORK,
+  CONFIG_SNAPSHOT,
+  CONFIG_HOLIDAYS
+};
+
+const char* const eventNames[EVENT_TYPE_COUNT] = {
+  "reset", "alarm_fired", "alarm_dismissed", "alarm_skipped", "ntp_sync",
+  "wifi_connected", "wifi_failed", "wifi_disconnected", "config_changed",
+  "time_set", "stall", "alarm_missed"
+};
+
+struct EventRecord {
+  uint32_t sequence;
+  uint32_t time;
+  int32_t value;
+  uint16_t type;
+  uint16_t extra;
+};
+
+#define EVENTLOG_SECTORS 4
+#define EVENTLOG_RECORDS_PER_SECTOR (FLASH_SECTOR_SIZE / sizeof(EventRecord))
+#define EVENTLOG_RECORDS (EVENTLOG_SECTORS * EVENTLOG_RECORDS_PER_SECTOR)
+#define EVENTLOG_STAGING 16
+#define EVENTLOG_FLUSH_MILLIS 60000
+#define EVENTLOG_EMPTY 0xFFFFFFFF
+
+EventRecord eventStaging[EVENTLOG_STAGING];
+int eventStagingLength = 0;
+uint32_t eventNextSequence = 0;
+uint32_t eventWritePosition = 0;
+unsigned long eventFirstStaged = 0;
+bool eventLogAvailable = false;
+std::function<uint32_t()> eventGetTime;
+
+uint32_t eventRecordAddress(uint32_t position){
+  return FS_PHYS_ADDR + position * sizeof(EventRecord);
+}
+
+bool readEventRecord(uint32_t position, EventRecord& record){
+  return ESP.flashRead(eventRecordAddress(position), (uint32_t*)&record, sizeof(record)) && record.sequence != EVENTLOG_EMPTY;
+}
+
+void flushEventLog(){
+  if(!eventLogAvailable || eventStagingLength == 0){
+    return;
+  }
+
+  int written = 0;
+  while(written < eventStagingLength){
+    // The oldest sector is erased only when the ring gets to it
+    if(eventWritePosition % EVENTLOG_RECORDS_PER_SECTOR == 0){
+      ESP.flashEraseSector(eventRecordAddress(eventWritePosition) / FLASH_SECTOR_SIZE);
+    }
+    int count = min((int)(EVENTLOG_RECORDS_PER_SECTOR - eventWritePosition % EVENTLOG_RECORDS_PER_SECTOR), eventStagingLength - written);
+    ESP.flashWrite(eventRecordAddress(eventWritePosition), (uint32_t*)&eventStaging[written], count * sizeof(EventRecord));
+    written += count;
+    eventWritePosition = (eventWritePosition + count) % EVENTLOG_RECORDS;
+  }
+  eventStagingLength = 0;
+}
+
+void logEvent(EventType type, int32_t value = 0, uint16_t extra = 0){
+  if(eventStagingLength == EVENTLOG_STAGING){
+    flushEventLog();
+    if(eventStagingLength == EVENTLOG_STAGING){
+      return;
+    }
+  }
+  if(eventStagingLength == 0){
+    eventFirstStaged = millis();
+  }
+
+  EventRecord& record = eventStaging[eventStagingLength++];
+  record.sequence = eventNextSequence++;
+  record.time = eventGetTime ? eventGetTime() : 0;
+  record.value = value;
+  record.type = type;
+  record.extra = extra;
+}
+
+void loopEventLog(){
+  if(eventStagingLength > 0 && millis() - eventFirstStaged > EVENTLOG_FLUSH_MILLIS){
+    flushEventLog();
+  }
+}
+
+// Appends a line for the record to the buffer, returns the new length
+size_t formatEventRecord(const EventRecord& record, char* buffer, size_t length, size_t size){
+  const char* name = record.type < EVENT_TYPE_COUNT ? eventNames[record.type] : "unknown";
+  int written = snprintf(buffer + length, size - length, "%u %u %s %d %u\n", record.sequence, record.time, name, record.value, record.extra);
+  return written > 0 ? length + written : length;
+}
+
+void handleEventLog(){
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+
+  char buffer[512];
+  size_t length = 0;
+  EventRecord record;
+  for(uint32_t i = 0; i < EVENTLOG_RECORDS + EVENTLOG_STAGING; i++){
+    if(i < EVENTLOG_RECORDS){
+      // From the oldest record, right after the last written one
+      if(!eventLogAvailable || !readEventRecord((eventWritePosition + i) % EVENTLOG_RECORDS, record)){
+        continue;
+      }
+    }else if(i - EVENTLOG_RECORDS < (uint32_t)eventStagingLength){
+      record = eventStaging[i - EVENTLOG_RECORDS];
+    }else{
+      break;
+    }
+
+    if(length > sizeof(buffer) - 64){
+      server.sendContent(buffer, length);
+      length = 0;
+    }
+    length = formatEventRecord(record, buffer, length, sizeof(buffer));
+  }
+  if(length > 0){
+    server.sendContent(buffer, length);
+  }
+  server.sendContent("");
+}
+
+void setupEventLog(const std::function<uint32_t()>& getTime){
+  eventGetTime = getTime;
+  eventLogAvailable = FS_PHYS_SIZE >= EVENTLOG_SECTORS * FLASH_SECTOR_SIZE;
+  if(!eventLogAvailable){
+    LOG_ERROR("No flash space for the event log\n");
+    return;
+  }
+
+  // The write position is right after the record with the highest sequence
+  bool found = false;
+  uint32_t lastSequence = 0;
+  EventRecord record;
+  for(uint32_t i = 0; i < EVENTLOG_RECORDS; i++){
+    if(readEventRecord(i, record) && record.type < EVENT_TYPE_COUNT && (!found || record.sequence > lastSequence)){
+      found = true;
+      lastSequence = record.sequence;
+      eventWritePosition = (i + 1) % EVENTLOG_RECORDS;
+    }
+  }
+  eventNextSequence = found ? lastSequence + 1 : 0;
+
+  server.on("/log", HTTP_GET, withAuthentication(handleEventLog));
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef FLEET_H
+
+#define FLEET_H
+
+#include <Arduino.h>
+#include <functional>
+
+#include "fleetpacket.h"
+
+/*
+  LAN fleet sync, enabled by defining FLEET_KEY in secrets.h (the same key on every clock)
+
+  The clocks talk on a UDP multicast group. The leader is the only one that syncs with NTP
+  and every FLEET_BEACON_MILLIS it multicasts its time, the others follow it and stop asking
+  NTP, after checking with a HELLO that the leader is really there. When no beacon arrives
+  for FLEET_LEADER_TIMEOUT a clock becomes the leader, and a leader steps down when it hears
+  one with a lower chip id.
+  When the alarms or the alarm sound change on a clock it multicasts them with a higher
+  config version, and every clock with an older version applies them. The leader also
+  repeats its config every FLEET_CONFIG_EVERY beacons for the clocks that were offline.
+
+  Every packet is signed with HMAC-SHA256 (truncated to 8 bytes) with FLEET_KEY.
+  The packets and the election are in include/fleetpacket.h, tools/fleet_loopback.cpp runs
+  several clocks on the loopback multicast of a computer.
+*/
+
+#ifdef FLEET_KEY
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "log.h"
+
+#define FLEET_PORT 4210
+#define FLEET_MULTICAST IPAddress(239, 83, 86, 70)
+
+WiFiUDP fleetUDP;
+bool fleetStarted = false;
+FleetNode fleet;
+uint32_t fleetLeaderAddress = 0;    // IPv4 address of the leader, valid while following
+
+std::function<uint32_t(uint16_t&)> fleetGetTime;
+std::function<void(uint32_t, uint16_t)> fleetSetTime;
+std::function<void(FleetConfig&)> fleetGetConfig;
+std::function<void(const FleetConfig&)> fleetApplyConfig;
+
+void fleetSend(const uint8_t* buffer, size_t length){
+  fleetUDP.beginPacketMulticast(FLEET_MULTICAST, FLEET_PORT, WiFi.localIP());
+  fleetUDP.write(buffer, length);
+  fleetUDP.endPacket();
+}
+
+// nonce is the one of the HELLO it answers, 0 for a beacon
+void sendFleetTime(uint32_t nonce = 0){
+  uint16_t fraction;
+  uint32_t epoch = fleetGetTime(fraction);
+  if(epoch == 0){
+    return;
+  }
+  uint8_t buffer[FLEET_MAX_L];
+  fleetSend(buffer, fleetTimePacket(buffer, FLEET_KEY, fleet.id, epoch, fraction, nonce));
+}
+
+void sendFleetHello(){
+  uint8_t buffer[FLEET_MAX_L];
+  fleetSend(buffer, fleetHelloPacket(buffer, FLEET_KEY, fleet.id, fleet.helloNonce()));
+}
+
+void sendFleetConfig(){
+  FleetConfig config;
+  fleetGetConfig(config);
+  uint8_t buffer[FLEET_MAX_L];
+  fleetSend(buffer, fleetConfigPacket(buffer, FLEET_KEY, fleet.id, fleet.configVersion, config));
+}
+
+// To be called after the alarms are changed on this clock, returns the new config version to save
+uint32_t fleetConfigChanged(){
+  fleet.configVersion++;
+  if(fleetStarted){
+    sendFleetConfig();
+  }
+  return fleet.configVersion;
+}
+
+void handleFleetPacket(const uint8_t* buffer, size_t length){
+  FleetPacket packet;
+  if(!fleetParsePacket(buffer, length, FLEET_KEY, packet)){
+    return;
+  }
+  if(packet.type == FLEET_TIME){
+    bool wasLeader = fleet.leader;
+    bool apply = fleet.acceptTime(packet, millis());
+    if(wasLeader && !fleet.leader){
+      LOG_INFO("Fleet: following %08x\n", packet.sender);
+    }
+    if(apply){
+      fleetLeaderAddress = fleetUDP.remoteIP();
+      fleetSetTime(packet.epoch, packet.fraction);
+    }
+  }else if(packet.type == FLEET_HELLO){
+    if(fleet.leader){
+      sendFleetTime(packet.nonce);
+    }
+  }else if(fleet.acceptConfig(packet)){
+    fleetApplyConfig(packet.config);
+  }
+}
+
+// True when the time comes from the leader, so there's no need to ask NTP
+bool fleetIsFollower(){
+  return fleetStarted && fleet.following(millis());
+}
+
+void loopFleetSync(){
+  if(WiFi.status() != WL_CONNECTED){
+    fleetStarted = false;
+    return;
+  }
+  if(!fleetStarted){
+    fleetStarted = fleetUDP.beginMulticast(WiFi.localIP(), FLEET_MULTICAST, FLEET_PORT);
+    fleet.start(millis(), RANDOM_REG32);
+    return;
+  }
+
+  uint8_t buffer[FLEET_MAX_L];
+  while(fleetUDP.parsePacket()){
+    size_t length = fleetUDP.read(buffer, sizeof(buffer));
+    handleFleetPacket(buffer, length);
+  }
+
+  bool wasLeader = fleet.leader;
+  uint8_t send = fleet.poll(millis());
+  if(fleet.leader && !wasLeader){
+    LOG_INFO("Fleet: now leader\n");
+  }
+  if(send & FLEET_SEND_TIME){
+    sendFleetTime();
+  }
+  if(send & FLEET_SEND_CONFIG){
+    sendFleetConfig();
+  }
+  if(send & FLEET_SEND_HELLO){
+    sendFleetHello();
+  }
+}
+
+void setupFleetSync(uint32_t configVersion, const std::function<uint32_t(uint16_t&)>& getTime, const std::function<void(uint32_t, uint16_t)>& setTime,
+                    const std::function<void(FleetConfig&)>& getConfig, const std::function<void(const FleetConfig&)>& applyConfig){
+  fleet.id = ESP.getChipId();
+  fleet.configVersion = configVersion;
+  fleetGetTime = getTime;
+  fleetSetTime = setTime;
+  fleetGetConfig = getConfig;
+  fleetApplyConfig = applyConfig;
+}
+
+#else
+
+uint32_t fleetLeaderAddress = 0;
+uint32_t fleetConfigChanged(){ return 0; }
+bool fleetIsFollower(){ return false; }
+void loopFleetSync(){}
+void setupFleetSync(uint32_t, const std::function<uint32_t(uint16_t&)>&, const std::function<void(uint32_t, uint16_t)>&,
+                    const std::function<void(FleetConfig&)>&, const std::function<void(const FleetConfig&)>&){}
+
+#endif
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef FLEETPACKET_H
+
+#define FLEETPACKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+/*
+  Packets and leader election of the LAN fleet sync (include/fleet.h)
+
+  -- PACKET (little endian) --
+  0-3 (uint32): magic "SVFL"
+  4 (byte): version
+  5 (byte): type
+  6-9 (uint32): sender chip id
+  TIME: 10-13 (uint32) UTC epoch, 14-15 (uint16) milliseconds, 16-19 (uint32) nonce of the
+        HELLO it answers, 0 in the periodic beacons
+  CONFIG: 10-13 (uint32) config version, 14-27 (byte[7][2]) alarmTimes, 28 (byte) selected alarm
+  HELLO: 10-13 (uint32) nonce
+  last 8 bytes: HMAC-SHA256 of the rest with the fleet key, truncated
+
+  FleetNode is the state of one clock: which clock leads, when it must send a beacon and
+  which beacons and configs it must apply. The time is passed in, so it doesn't know
+  about millis() or the network.
+  A signed beacon recorded earlier is still valid, so the time of a leader is trusted only
+  after it answered a HELLO with a nonce that changes at every boot and every answer, then
+  only beacons that don't go back in time.
+
+  This file must not depend on Arduino, tools/fleet_loopback.cpp includes it too.
+*/
+
+#define FLEET_MAGIC 0x4C465653UL
+#define FLEET_VERSION 2
+#define FLEET_TIME 1
+#define FLEET_CONFIG 2
+#define FLEET_HELLO 3
+#define FLEET_HEADER_L 10
+#define FLEET_TIME_L (FLEET_HEADER_L + 10)
+#define FLEET_CONFIG_L (FLEET_HEADER_L + 19)
+#define FLEET_HELLO_L (FLEET_HEADER_L + 4)
+#define FLEET_MAC_L 8
+#define FLEET_MAX_L 48
+#define FLEET_BEACON_MILLIS 10000
+#define FLEET_LEADER_TIMEOUT 30000
+#define FLEET_CONFIG_EVERY 6
+#define FLEET_HELLO_MILLIS 1000
+
+// What FleetNode::poll() asks to send
+#define FLEET_SEND_TIME 0x01
+#define FLEET_SEND_CONFIG 0x02
+#define FLEET_SEND_HELLO 0x04
+
+struct FleetConfig {
+  uint32_t version;
+  uint8_t alarmTimes[7][2];
+  uint8_t selectedAlarm;
+};
+
+//
+// --- HMAC-SHA256 ---
+//
+
+struct FleetSha256 {
+  uint32_t state[8];
+  uint8_t block[64];
+  uint64_t length;
+};
+
+static const uint32_t fleetSha256K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t fleetRotate(uint32_t value, int bits){
+  return (value >> bits) | (value << (32 - bits));
+}
+
+static void fleetSha256Block(FleetSha256& sha){
+  uint32_t w[64];
+  for(int i = 0; i < 16; i++){
+    w[i] = ((uint32_t)sha.block[i * 4] << 24) | ((uint32_t)sha.block[i * 4 + 1] << 16) | ((uint32_t)sha.block[i * 4 + 2] << 8) | sha.block[i * 4 + 3];
+  }
+  for(int i = 16; i < 64; i++){
+    uint32_t s0 = fleetRotate(w[i - 15], 7) ^ fleetRotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = fleetRotate(w[i - 2], 17) ^ fleetRotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t v[8];
+  memcpy(v, sha.state, sizeof(v));
+  for(int i = 0; i < 64; i++){
+    uint32_t s1 = fleetRotate(v[4], 6) ^ fleetRotate(v[4], 11) ^ fleetRotate(v[4], 25);
+    uint32_t t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + fleetSha256K[i] + w[i];
+    uint32_t s0 = fleetRotate(v[0], 2) ^ fleetRotate(v[0], 13) ^ fleetRotate(v[0], 22);
+    uint32_t t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+    memmove(v + 1, v, 7 * sizeof(uint32_t));
+    v[4] += t1;
+    v[0] = t1 + t2;
+  }
+  for(int i = 0; i < 8; i++){
+    sha.state[i] += v[i];
+  }
+}
+
+static void fleetSha256Init(FleetSha256& sha){
+  static const uint32_t initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+  memcpy(sha.state, initial, sizeof(initial));
+  sha.length = 0;
+}
+
+static void fleetSha256Update(FleetSha256& sha, const uint8_t* data, size_t length){
+  for(size_t i = 0; i < length; i++){
+    sha.block[sha.length++ % 64] = data[i];
+    if(sha.length % 64 == 0){
+      fleetSha256Block(sha);
+    }
+  }
+}
+
+static void fleetSha256Final(FleetSha256& sha, uint8_t* digest){
+  uint64_t bits = sha.length * 8;
+  uint8_t padding = 0x80;
+  fleetSha256Update(sha, &padding, 1);
+  padding = 0;
+  while(sha.length % 64 != 56){
+    fleetSha256Update(sha, &padding, 1);
+  }
+  for(int i = 7; i >= 0; i--){
+    uint8_t value = bits >> (i * 8);
+    fleetSha256Update(sha, &value, 1);
+  }
+  for(int i = 0; i < 32; i++){
+    digest[i] = sha.state[i / 4] >> (24 - (i % 4) * 8);
+  }
+}
+
+// HMAC-SHA256 of data with key, only the first macLength bytes are written
+void fleetHmac(const char* key, const uint8_t* data, size_t length, uint8_t* mac, size_t macLength){
+  uint8_t pad[64] = {};
+  size_t keyLength = strlen(key);
+  FleetSha256 sha;
+  if(keyLength > sizeof(pad)){
+    fleetSha256Init(sha);
+    fleetSha256Update(sha, (const uint8_t*)key, keyLength);
+    fleetSha256Final(sha, pad);
+  }else{
+    memcpy(pad, key, keyLength);
+  }
+
+  uint8_t digest[32];
+  for(int i = 0; i < 64; i++) pad[i] ^= 0x36;
+  fleetSha256Init(sha);
+  fleetSha256Update(sha, pad, sizeof(pad));
+  fleetSha256Update(sha, data, length);
+  fleetSha256Final(sha, digest);
+
+  for(int i = 0; i < 64; i++) pad[i] ^= 0x36 ^ 0x5c;
+  fleetSha256Init(sha);
+  fleetSha256Update(sha, pad, sizeof(pad));
+  fleetSha256Update(sha, digest, sizeof(digest));
+  fleetSha256Final(sha, digest);
+  memcpy(mac, digest, macLength);
+}
+
+//
+// --- PACKETS ---
+//
+
+size_t fleetHeader(uint8_t* buffer, uint8_t type, uint32_t sender){
+  snapshotWrite32(buffer, FLEET_MAGIC);
+  buffer[4] = FLEET_VERSION;
+  buffer[5] = type;
+  snapshotWrite32(buffer + 6, sender);
+  return FLEET_HEADER_L;
+}
+
+// The packet builders return the length with the MAC, buffer must hold FLEET_MAX_L bytes
+size_t fleetTimePacket(uint8_t* buffer, const char* key, uint32_t sender, uint32_t epoch, uint16_t fraction, uint32_t nonce = 0){
+  size_t length = fleetHeader(buffer, FLEET_TIME, sender);
+  snapshotWrite32(buffer + length, epoch);
+  buffer[length + 4] = fraction;
+  buffer[length + 5] = fraction >> 8;
+  snapshotWrite32(buffer + length + 6, nonce);
+  fleetHmac(key, buffer, FLEET_TIME_L, buffer + FLEET_TIME_L, FLEET_MAC_L);
+  return FLEET_TIME_L + FLEET_MAC_L;
+}
+
+size_t fleetConfigPacket(uint8_t* buffer, const char* key, uint32_t sender, uint32_t version, const FleetConfig& config){
+  size_t length = fleetHeader(buffer, FLEET_CONFIG, sender);
+  snapshotWrite32(buffer + length, version);
+  memcpy(buffer + length + 4, config.alarmTimes, 14);
+  buffer[length + 18] = config.selectedAlarm;
+  fleetHmac(key, buffer, FLEET_CONFIG_L, buffer + FLEET_CONFIG_L, FLEET_MAC_L);
+  return FLEET_CONFIG_L + FLEET_MAC_L;
+}
+
+size_t fleetHelloPacket(uint8_t* buffer, const char* key, uint32_t sender, uint32_t nonce){
+  size_t length = fleetHeader(buffer, FLEET_HELLO, sender);
+  snapshotWrite32(buffer + length, nonce);
+  fleetHmac(key, buffer, FLEET_HELLO_L, buffer + FLEET_HELLO_L, FLEET_MAC_L);
+  return FLEET_HELLO_L + FLEET_MAC_L;
+}
+
+struct FleetPacket {
+  uint8_t type;
+  uint32_t sender;
+  uint32_t epoch;
+  uint16_t fraction;
+  uint32_t nonce;
+  FleetConfig config;     // config.version is the version of the packet
+};
+
+// False if the packet is malformed, of another version or not signed with key
+bool fleetParsePacket(const uint8_t* buffer, size_t length, const char* key, FleetPacket& packet){
+  if(length < FLEET_HEADER_L + FLEET_MAC_L || snapshotRead32(buffer) != FLEET_MAGIC || buffer[4] != FLEET_VERSION){
+    return false;
+  }
+  length -= FLEET_MAC_L;
+  uint8_t mac[FLEET_MAC_L];
+  fleetHmac(key, buffer, length, mac, FLEET_MAC_L);
+  if(memcmp(mac, buffer + length, FLEET_MAC_L) != 0){
+    return false;
+  }
+
+  const uint8_t* payload = buffer + FLEET_HEADER_L;
+  packet.type = buffer[5];
+  packet.sender = snapshotRead32(buffer + 6);
+  if(packet.type == FLEET_TIME && length == FLEET_TIME_L){
+    packet.epoch = snapshotRead32(payload);
+    packet.fraction = payload[4] | (payload[5] << 8);
+    packet.nonce = snapshotRead32(payload + 6);
+    return true;
+  }else if(packet.type == FLEET_CONFIG && length == FLEET_CONFIG_L){
+    packet.config.version = snapshotRead32(payload);
+    memcpy(packet.config.alarmTimes, payload + 4, 14);
+    packet.config.selectedAlarm = payload[18];
+    return true;
+  }else if(packet.type == FLEET_HELLO && length == FLEET_HELLO_L){
+    packet.nonce = snapshotRead32(payload);
+    return true;
+  }
+  return false;
+}
+
+//
+// --- LEADER ELECTION ---
+//
+
+// When no beacon arrives for FLEET_LEADER_TIMEOUT a clock becomes the leader, and a leader
+// steps down when it hears one with a lower id
+class FleetNode {
+public:
+  uint32_t id = 0;
+  bool leader = false;
+  uint32_t leaderId = 0;
+  uint32_t configVersion = 0;
+
+  // When the clock joins the group, it waits a whole timeout for a leader.
+  // nonce must be random at every boot
+  void start(unsigned long now, uint32_t nonce) {
+    lastBeacon = now;
+    this->nonce = nonce ? nonce : 1;
+    trustedId = 0;
+    helloPending = false;
+  }
+
+  // The nonce the next HELLO carries
+  uint32_t helloNonce() const {
+    return nonce;
+  }
+
+  // True if the beacon comes from the leader and its time must be applied
+  bool acceptTime(const FleetPacket& packet, unsigned long now) {
+    if(packet.sender == id){
+      return false;
+    }
+    if(leader){
+      if(packet.sender > id){
+        return false;
+      }
+    }else if(leaderId != 0 && packet.sender > leaderId && now - lastBeacon < FLEET_LEADER_TIMEOUT){
+      return false;
+    }
+
+    // A new leader must answer a HELLO first, then old beacons sent again are ignored
+    if(packet.sender != trustedId){
+      if(packet.nonce != nonce){
+        helloPending = true;
+        return false;
+      }
+      trustedId = packet.sender;
+      nonce = nonce * 1664525 + 1013904223;   // An answer is accepted once
+      nonce = nonce ? nonce : 1;
+    }else if(packet.epoch < lastEpoch){
+      return false;
+    }
+    leader = false;
+    leaderId = packet.sender;
+    lastEpoch = packet.epoch;
+    lastBeacon = now;
+    return true;
+  }
+
+  // True if the config is newer than the one of this clock and must be applied
+  bool acceptConfig(const FleetPacket& packet) {
+    if(packet.sender == id || packet.config.version <= configVersion){
+      return false;
+    }
+    configVersion = packet.config.version;
+    return true;
+  }
+
+  bool following(unsigned long now) const {
+    return !leader && leaderId != 0 && now - lastBeacon < FLEET_LEADER_TIMEOUT;
+  }
+
+  // Returns the FLEET_SEND_ flags of the packets to send now
+  uint8_t poll(unsigned long now) {
+    // Every clock waits a different time, so they don't all become leaders together
+    if(!leader && now - lastBeacon > FLEET_LEADER_TIMEOUT + (id % 16) * 1000){
+      leader = true;
+    }
+    uint8_t send = 0;
+    if(helloPending && (!helloSent || now - lastHello >= FLEET_HELLO_MILLIS)){
+      helloPending = false;
+      helloSent = true;
+      lastHello = now;
+      send |= FLEET_SEND_HELLO;
+    }
+    if(!leader || now - lastSent <= FLEET_BEACON_MILLIS){
+      return send;
+    }
+    lastSent = now;
+
+    // The config is sent again from time to time for the clocks that just joined
+    if(configVersion > 0 && ++beaconsSent % FLEET_CONFIG_EVERY == 0){
+      return send | FLEET_SEND_TIME | FLEET_SEND_CONFIG;
+    }
+    return send | FLEET_SEND_TIME;
+  }
+
+private:
+  uint32_t nonce = 1;
+  uint32_t trustedId = 0;     // The leader that answered the last HELLO
+  bool helloPending = false;
+  bool helloSent = false;
+  unsigned long lastHello = 0;
+  uint32_t lastEpoch = 0;
+  unsigned long lastBeacon = 0;
+  unsigned long lastSent = 0;
+  unsigned int beaconsSent = 0;
+};
+
+#endif
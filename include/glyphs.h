@@ -0,0 +1,162 @@
+#ifndef GLYPHS_H
+
+#define GLYPHS_H
+
+#include <Arduino.h>
+
+#include "lcd.h"
+#include "log.h"
+
+/*
+  The LCD only has 8 CGRAM slots for custom chars, but all the screens together use more glyphs.
+  The GlyphManager maps the logical glyphs on the slots and only uploads a glyph when the
+  screen needs it and it isn't already in a slot, evicting the least recently used one.
+  Slots used by the current screen are never evicted, otherwise the text already on the
+  screen would change.
+*/
+
+enum Glyph : uint8_t {
+  GLYPH_DOWN_ARROW,
+  GLYPH_UP_ARROW,
+  GLYPH_UPPER_BAR,
+  GLYPH_LOWER_BAR,
+  GLYPH_DOUBLE_BAR,
+  GLYPH_WIFI_ON,
+  GLYPH_WIFI_OFF,
+  GLYPH_ALARM_ARMED,
+  GLYPH_ALARM_DISMISSED,
+  GLYPH_COUNT
+};
+
+#define GLYPH_NONE 255
+#define GLYPH_SLOTS 8
+
+const uint8_t glyphBitmaps[GLYPH_COUNT][8] PROGMEM = {
+  { B00000, B00000, B00000, B00000, B00000, B11111, B01110, B00100 },   // Down arrow
+  { B00100, B01110, B11111, B00000, B00000, B00000, B00000, B00000 },   // Up arrow
+  { B11111, B11111, B11111, B00000, B00000, B00000, B00000, B00000 },   // Upper bar
+  { B00000, B00000, B00000, B00000, B00000, B11111, B11111, B11111 },   // Lower bar
+  { B11111, B11111, B11111, B00000, B00000, B00000, B11111, B11111 },   // Double bar
+  { B00000, B01110, B10001, B00100, B01010, B00000, B00100, B00000 },   // WiFi on
+  { B10001, B01010, B00100, B01010, B10001, B00000, B00100, B00000 },   // WiFi off
+  { B00100, B01110, B01110, B01110, B11111, B00000, B00100, B00000 },   // Alarm armed
+  { B00101, B01110, B01110, B01110, B11111, B10000, B00100, B00000 }    // Alarm dismissed
+};
+
+class GlyphManager {
+public:
+  GlyphManager(BatchedLCD& lcd) : lcd(lcd) {
+    memset(slotGlyph, GLYPH_NONE, sizeof(slotGlyph));
+    memset(slotLastUse, 0, sizeof(slotLastUse));
+  }
+
+  // Must be called before drawing a new screen, the glyphs of the previous one can then be evicted
+  void beginScreen() {
+    if(screenUploads > 0){
+      LOG_DEBUG("CGRAM uploads for the last screen: %u\n", screenUploads);
+    }
+    screenSlots = 0;
+    screenUploads = 0;
+  }
+
+  // Returns the char code to print to show the glyph
+  uint8_t get(Glyph glyph) {
+    useCounter++;
+    int slot = -1;
+    for(int i = 0; i < GLYPH_SLOTS; i++){
+      if(slotGlyph[i] == glyph){
+        slot = i;
+        break;
+      }
+    }
+
+    if(slot == -1){
+      slot = findFreeSlot();
+      uint8_t bitmap[8];
+      memcpy_P(bitmap, glyphBitmaps[glyph], sizeof(bitmap));
+      lcd.createChar(slot, bitmap);
+      slotGlyph[slot] = glyph;
+      screenUploads++;
+      totalUploads++;
+    }
+
+    slotLastUse[slot] = useCounter;
+    screenSlots |= 1 << slot;
+    return slot;
+  }
+
+  unsigned int getScreenUploads() const {
+    return screenUploads;
+  }
+
+  unsigned long getTotalUploads() const {
+    return totalUploads;
+  }
+
+private:
+  BatchedLCD& lcd;
+  uint8_t slotGlyph[GLYPH_SLOTS];
+  unsigned long slotLastUse[GLYPH_SLOTS];
+  unsigned long useCounter = 0;
+  uint8_t screenSlots = 0;
+  unsigned int screenUploads = 0;
+  unsigned long totalUploads = 0;
+
+  int findFreeSlot() {
+    int lru = -1;
+    for(int i = 0; i < GLYPH_SLOTS; i++){
+      if(slotGlyph[i] == GLYPH_NONE){
+        return i;
+      }
+      if(!(screenSlots & (1 << i)) && (lru == -1 || slotLastUse[i] < slotLastUse[lru])){
+        lru = i;
+      }
+    }
+
+    // More than 8 glyphs on a single screen, the oldest one will be wrong
+    if(lru == -1){
+      lru = 0;
+      for(int i = 1; i < GLYPH_SLOTS; i++){
+        if(slotLastUse[i] < slotLastUse[lru]){
+          lru = i;
+        }
+      }
+    }
+    return lru;
+  }
+};
+
+//
+// --- BIG DIGITS ---
+//
+
+// Each digit is 3x2 chars, values that aren't glyphs are printed as they are
+#define BIG_BLANK ' '
+#define BIG_FULL 0xFF
+
+const uint8_t bigDigits[10][6] PROGMEM = {
+  { BIG_FULL, GLYPH_UPPER_BAR, BIG_FULL,           BIG_FULL, GLYPH_LOWER_BAR, BIG_FULL },                 // 0
+  { GLYPH_UPPER_BAR, BIG_FULL, BIG_BLANK,          GLYPH_LOWER_BAR, BIG_FULL, GLYPH_LOWER_BAR },          // 1
+  { GLYPH_DOUBLE_BAR, GLYPH_DOUBLE_BAR, BIG_FULL,  BIG_FULL, GLYPH_LOWER_BAR, GLYPH_LOWER_BAR },          // 2
+  { GLYPH_DOUBLE_BAR, GLYPH_DOUBLE_BAR, BIG_FULL,  GLYPH_LOWER_BAR, GLYPH_LOWER_BAR, BIG_FULL },          // 3
+  { BIG_FULL, GLYPH_LOWER_BAR, BIG_FULL,           BIG_BLANK, BIG_BLANK, BIG_FULL },                      // 4
+  { BIG_FULL, GLYPH_DOUBLE_BAR, GLYPH_DOUBLE_BAR,  GLYPH_LOWER_BAR, GLYPH_LOWER_BAR, BIG_FULL },          // 5
+  { BIG_FULL, GLYPH_DOUBLE_BAR, GLYPH_DOUBLE_BAR,  BIG_FULL, GLYPH_LOWER_BAR, BIG_FULL },                 // 6
+  { GLYPH_UPPER_BAR, GLYPH_UPPER_BAR, BIG_FULL,    BIG_BLANK, BIG_BLANK, BIG_FULL },                      // 7
+  { BIG_FULL, GLYPH_DOUBLE_BAR, BIG_FULL,          BIG_FULL, GLYPH_LOWER_BAR, BIG_FULL },                 // 8
+  { BIG_FULL, GLYPH_DOUBLE_BAR, BIG_FULL,          GLYPH_LOWER_BAR, GLYPH_LOWER_BAR, BIG_FULL }           // 9
+};
+
+void printBigDigit(BatchedLCD& lcd, GlyphManager& glyphs, int digit, int col, int row){
+  for(int r = 0; r < 2; r++){
+    uint8_t line[3];
+    for(int c = 0; c < 3; c++){
+      uint8_t value = pgm_read_byte(&bigDigits[digit][r * 3 + c]);
+      line[c] = value < GLYPH_COUNT ? glyphs.get((Glyph)value) : value;
+    }
+    lcd.setCursor(col, row + r);
+    lcd.write(line, 3);
+  }
+}
+
+#endif
@@ -0,0 +1,285 @@
+#ifndef HOLIDAYS_H
+
+#define HOLIDAYS_H
+
+#include <Arduino.h>
+#include <flash_hal.h>
+#include <time.h>
+
+#include "webserver.h"
+#include "eventlog.h"
+#include "log.h"
+
+/*
+  Calendar of the days when the weekly alarms don't ring (holidays, vacations)
+
+  Every year is a bitmap with a bit for each day of the year, stored in the flash sector
+  after the event log. The bitmaps of the current and of the next year are kept in RAM,
+  so checking a day is a subtraction and a bit test, and flash is only read again when
+  the date gets past the next year.
+  The temporary alarm still rings on a skipped day, it's set on purpose.
+
+  POST /holidays adds the date ranges in the body, one per line as "YYYY-MM-DD" or
+  "YYYY-MM-DD YYYY-MM-DD" (inclusive), or removes them with ?clear=1.
+  GET /holidays?year=YYYY lists the skipped ranges of the year.
+
+  -- SECTOR --
+  0-3 (uint32): magic "SVHD"
+  4-7 (uint32): number of years
+  then HOLIDAY_YEARS times: 0-3 (int32) year, 4-51 (byte[48]) bitmap, bit 0 is January 1st
+*/
+
+#define HOLIDAY_MAGIC 0x44485653UL
+#define HOLIDAY_YEARS 16
+#define HOLIDAY_BYTES 48
+#define HOLIDAY_MAX_RANGE 732
+#define HOLIDAY_ADDRESS (FS_PHYS_ADDR + EVENTLOG_SECTORS * FLASH_SECTOR_SIZE)
+
+struct HolidayYear {
+  int32_t year;
+  uint8_t days[HOLIDAY_BYTES];
+};
+
+struct HolidayTable {
+  uint32_t magic;
+  uint32_t count;
+  HolidayYear years[HOLIDAY_YEARS];
+};
+
+struct HolidayCache {
+  int32_t firstDay;     // Days since 1/1/1970 of January 1st
+  int32_t length;       // 365 or 366
+  uint8_t days[HOLIDAY_BYTES];
+};
+
+HolidayCache holidayCache[2];   // Current and next year
+bool holidaysAvailable = false;
+
+bool isLeapYear(int32_t year){
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// Days since 1/1/1970 of a date, month and day start from 1
+int32_t epochDay(int32_t year, int month, int day){
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  int32_t yearOfEra = year - era * 400;
+  int32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+int32_t yearOfEpochDay(int32_t days){
+  days += 719468;
+  int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int32_t dayOfEra = days - era * 146097;
+  int32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  int32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  int32_t monthIndex = (5 * dayOfYear + 2) / 153;
+  return yearOfEra + era * 400 + (monthIndex >= 10);
+}
+
+// An erased or invalid sector is an empty table
+void readHolidayTable(HolidayTable& table){
+  if(!ESP.flashRead(HOLIDAY_ADDRESS, (uint32_t*)&table, sizeof(table)) || table.magic != HOLIDAY_MAGIC || table.count > HOLIDAY_YEARS){
+    table.magic = HOLIDAY_MAGIC;
+    table.count = 0;
+  }
+}
+
+bool writeHolidayTable(const HolidayTable& table){
+  return ESP.flashEraseSector(HOLIDAY_ADDRESS / FLASH_SECTOR_SIZE) && ESP.flashWrite(HOLIDAY_ADDRESS, (uint32_t*)&table, sizeof(table));
+}
+
+void loadHolidayYear(const HolidayTable& table, int32_t year, HolidayCache& cache){
+  cache.firstDay = epochDay(year, 1, 1);
+  cache.length = isLeapYear(year) ? 366 : 365;
+  memset(cache.days, 0, sizeof(cache.days));
+  for(uint32_t i = 0; i < table.count; i++){
+    if(table.years[i].year == year){
+      memcpy(cache.days, table.years[i].days, sizeof(cache.days));
+    }
+  }
+}
+
+// The table is too big for the stack of the loop
+HolidayTable* loadHolidayTable(){
+  HolidayTable* table = new HolidayTable;
+  readHolidayTable(*table);
+  return table;
+}
+
+void loadHolidayCache(int32_t year){
+  HolidayTable* table = loadHolidayTable();
+  loadHolidayYear(*table, year, holidayCache[0]);
+  loadHolidayYear(*table, year + 1, holidayCache[1]);
+  delete table;
+}
+
+bool testHolidayBit(const HolidayCache& cache, int32_t index){
+  return cache.days[index >> 3] & (1 << (index & 7));
+}
+
+// day: days since 1/1/1970 in local time
+bool isDaySkipped(int32_t day){
+  if(!holidaysAvailable){
+    return false;
+  }
+  int32_t index = day - holidayCache[0].firstDay;
+  if(index >= 0 && index < holidayCache[0].length){
+    return testHolidayBit(holidayCache[0], index);
+  }
+  index -= holidayCache[0].length;
+  if(index >= 0 && index < holidayCache[1].length){
+    return testHolidayBit(holidayCache[1], index);
+  }
+
+  // The date isn't in the cache anymore, the bitmaps of its year and the next one are loaded
+  loadHolidayCache(yearOfEpochDay(day));
+  return testHolidayBit(holidayCache[0], day - holidayCache[0].firstDay);
+}
+
+HolidayYear* findHolidayYear(HolidayTable& table, int32_t year, int32_t currentYear){
+  for(uint32_t i = 0; i < table.count; i++){
+    if(table.years[i].year == year){
+      return &table.years[i];
+    }
+  }
+
+  // When the table is full, the oldest past year makes room
+  HolidayYear* entry = nullptr;
+  if(table.count < HOLIDAY_YEARS){
+    entry = &table.years[table.count++];
+  }else{
+    for(uint32_t i = 0; i < table.count; i++){
+      if(table.years[i].year < currentYear && (entry == nullptr || table.years[i].year < entry->year)){
+        entry = &table.years[i];
+      }
+    }
+    if(entry == nullptr){
+      return nullptr;
+    }
+  }
+  entry->year = year;
+  memset(entry->days, 0, sizeof(entry->days));
+  return entry;
+}
+
+bool parseHolidayDate(const char* text, int32_t& day){
+  int year, month, mday;
+  static const uint8_t monthDays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  if(sscanf(text, "%d-%d-%d", &year, &month, &mday) != 3 || month < 1 || month > 12 || mday < 1){
+    return false;
+  }
+  if(mday > monthDays[month - 1] + (month == 2 && isLeapYear(year))){
+    return false;
+  }
+  day = epochDay(year, month, mday);
+  return true;
+}
+
+// Returns the number of days changed, -1 if a line isn't valid or the table is full
+int setHolidayRanges(HolidayTable& table, const String& body, bool skip, int32_t currentYear){
+  int changed = 0;
+  int start = 0;
+  while(start < (int)body.length()){
+    int end = body.indexOf('\n', start);
+    if(end < 0){
+      end = body.length();
+    }
+    String line = body.substring(start, end);
+    start = end + 1;
+    line.trim();
+    if(line.length() == 0){
+      continue;
+    }
+
+    int32_t from, to;
+    int separator = line.indexOf(' ');
+    if(!parseHolidayDate(line.c_str(), from) || !parseHolidayDate(separator > 0 ? line.c_str() + separator + 1 : line.c_str(), to)
+       || to < from || to - from > HOLIDAY_MAX_RANGE){
+      return -1;
+    }
+
+    HolidayYear* entry = nullptr;
+    int32_t firstDay = 0;
+    for(int32_t day = from; day <= to; day++){
+      if(entry == nullptr || day - firstDay >= (isLeapYear(entry->year) ? 366 : 365)){
+        int32_t year = yearOfEpochDay(day);
+        entry = findHolidayYear(table, year, currentYear);
+        if(entry == nullptr){
+          return -1;
+        }
+        firstDay = epochDay(year, 1, 1);
+      }
+      int32_t index = day - firstDay;
+      uint8_t bit = 1 << (index & 7);
+      if(((entry->days[index >> 3] & bit) != 0) != skip){
+        entry->days[index >> 3] ^= bit;
+        changed++;
+      }
+    }
+  }
+  return changed;
+}
+
+void handleSetHolidays(const std::function<unsigned long()>& getTime){
+  HolidayTable* table = loadHolidayTable();
+  int32_t currentYear = yearOfEpochDay(getTime() / 86400);
+  int changed = setHolidayRanges(*table, server.arg("plain"), server.arg("clear") != "1", currentYear);
+  if(changed < 0){
+    server.send(400, "text/plain", "Invalid range or too many years");
+  }else{
+    if(changed > 0){
+      writeHolidayTable(*table);
+      loadHolidayCache(currentYear);
+      logEvent(EVENT_CONFIG_CHANGED, CONFIG_HOLIDAYS);
+    }
+    server.send(200, "text/plain", String(changed) + " days changed\n");
+  }
+  delete table;
+}
+
+void handleGetHolidays(){
+  int32_t year = server.arg("year").toInt();
+  HolidayCache cache;
+  HolidayTable* table = loadHolidayTable();
+  loadHolidayYear(*table, year, cache);
+  delete table;
+
+  // Consecutive skipped days are printed as a range
+  String text;
+  int32_t rangeStart = -1;
+  for(int32_t i = 0; i <= cache.length; i++){
+    bool skipped = i < cache.length && testHolidayBit(cache, i);
+    if(skipped && rangeStart < 0){
+      rangeStart = i;
+    }else if(!skipped && rangeStart >= 0){
+      char line[32];
+      time_t first = (time_t)(cache.firstDay + rangeStart) * 86400;
+      time_t last = (time_t)(cache.firstDay + i - 1) * 86400;
+      size_t length = strftime(line, sizeof(line), "%Y-%m-%d ", gmtime(&first));
+      strftime(line + length, sizeof(line) - length, "%Y-%m-%d\n", gmtime(&last));
+      text += line;
+      rangeStart = -1;
+    }
+  }
+  server.send(200, "text/plain", text);
+}
+
+// getTime returns the local time, 0 if it isn't known yet
+void setupHolidays(const std::function<unsigned long()>& getTime){
+  holidaysAvailable = FS_PHYS_SIZE >= (EVENTLOG_SECTORS + 1) * FLASH_SECTOR_SIZE;
+  if(!holidaysAvailable){
+    LOG_ERROR("No flash space for the holiday calendar\n");
+    return;
+  }
+  // Nothing is cached until the first check, the date may not be known yet
+  holidayCache[0].firstDay = holidayCache[1].firstDay = 0;
+  holidayCache[0].length = holidayCache[1].length = 0;
+
+  server.on("/holidays", HTTP_GET, withAuthentication(handleGetHolidays));
+  server.on("/holidays", HTTP_POST, withAuthentication([getTime](){handleSetHolidays(getTime);}));
+}
+
+#endif
@@ -1,24 +1,43 @@
 #pragma once
 
-const uint16_t html_index_L = 302;
+const uint16_t html_index_L = 593;
 const uint8_t html_index[] PROGMEM = {
-	0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x6d, 0x8f, 0xcd, 0x6e, 0x83, 0x30, 
-	0x10, 0x84, 0xef, 0x79, 0x0a, 0x37, 0xe7, 0x52, 0x92, 0x5b, 0x45, 0x6c, 0x2e, 0xf9, 0x91, 0x7a, 
-	0x6a, 0x24, 0x52, 0x55, 0x3d, 0x3a, 0xf6, 0x02, 0x2b, 0x19, 0xdb, 0xc2, 0x0b, 0x04, 0x55, 0x7d, 
-	0xf7, 0x3a, 0x80, 0x2a, 0x55, 0xad, 0x0f, 0xb6, 0x76, 0x3c, 0xdf, 0xee, 0x0e, 0x7f, 0x38, 0xbc, 
-	0xee, 0x2f, 0x1f, 0xe7, 0x23, 0xab, 0xa9, 0x31, 0x39, 0xbf, 0xdf, 0xcc, 0x48, 0x5b, 0x09, 0xb0, 
-	0x39, 0x6f, 0x80, 0x24, 0x53, 0xb5, 0x6c, 0x03, 0x90, 0x78, 0xbb, 0x9c, 0x92, 0xe7, 0x45, 0xb3, 
-	0xb2, 0x01, 0xd1, 0x23, 0x0c, 0xde, 0xb5, 0xc4, 0x94, 0xb3, 0x04, 0x96, 0xc4, 0x7a, 0x40, 0x4d, 
-	0xb5, 0xd0, 0xd0, 0xa3, 0x82, 0x64, 0x2a, 0x1e, 0x19, 0x5a, 0x24, 0x94, 0x26, 0x09, 0x4a, 0x1a, 
-	0x10, 0xdb, 0xa7, 0xcd, 0x3a, 0xe7, 0x84, 0x64, 0x20, 0x3f, 0x16, 0xe7, 0xa2, 0x87, 0xca, 0xa0, 
-	0xe4, 0xe9, 0xac, 0xf0, 0x40, 0x63, 0x7c, 0x4a, 0xd7, 0x36, 0x9f, 0xa5, 0x81, 0x5b, 0xa2, 0xb1, 
-	0x05, 0x45, 0xe8, 0x6c, 0xa6, 0x9c, 0xe9, 0x1a, 0xbb, 0x93, 0x06, 0x2b, 0x9b, 0x20, 0x41, 0x13, 
-	0x32, 0x15, 0x67, 0x42, 0xbb, 0xab, 0xa4, 0xcf, 0xb6, 0x1b, 0x7f, 0xdb, 0x69, 0x0c, 0xde, 0xc8, 
-	0x31, 0xbb, 0x93, 0x5f, 0x3c, 0x9d, 0x7b, 0xf1, 0xab, 0xd3, 0x63, 0xbe, 0x62, 0xf1, 0xf0, 0x7b, 
-	0x5f, 0x26, 0xa7, 0x7e, 0x22, 0x8d, 0x91, 0xde, 0xb1, 0x44, 0x16, 0xf3, 0xd4, 0x4e, 0x0b, 0xef, 
-	0x02, 0xcd, 0xb1, 0x86, 0xa8, 0x9e, 0xa2, 0x73, 0x86, 0x26, 0x10, 0xad, 0xef, 0x96, 0xdf, 0x10, 
-	0x50, 0xb3, 0x38, 0x46, 0x41, 0xed, 0x8c, 0x86, 0x56, 0x14, 0xc5, 0xcb, 0xe1, 0x8f, 0x95, 0x46, 
-	0x0f, 0xc2, 0xcb, 0x10, 0x06, 0xd7, 0xea, 0x19, 0x9c, 0xaa, 0xdf, 0xe8, 0x79, 0x31, 0xfc, 0x8f, 
-	0x87, 0xee, 0xda, 0x20, 0xb1, 0x5e, 0x9a, 0x0e, 0xc4, 0xde, 0x59, 0x0b, 0x44, 0xb8, 0x24, 0x49, 
-	0xcb, 0x9f, 0x05, 0x57, 0xab, 0x6f, 0xe3, 0x2e, 0x1a, 0xaf, 0xc4, 0x01, 0x00, 0x00 
+	0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x53, 0xcb, 0x6e, 0xdb, 0x30, 
+	0x10, 0xbc, 0xf7, 0x2b, 0x58, 0x5d, 0x6a, 0x01, 0x96, 0x65, 0x03, 0x3d, 0xb4, 0xb2, 0xe8, 0x00, 
+	0xcd, 0x03, 0x08, 0xd0, 0x22, 0x46, 0xed, 0xa0, 0xe8, 0x91, 0xa1, 0x56, 0xd6, 0x22, 0x14, 0xc9, 
+	0x92, 0x2b, 0x2b, 0x8e, 0xe1, 0x7f, 0xe9, 0xbf, 0xf4, 0xc7, 0x4a, 0x3d, 0xdc, 0x36, 0x48, 0x75, 
+	0x90, 0xc8, 0xe5, 0xcc, 0xee, 0xce, 0x0e, 0x95, 0xbf, 0xbd, 0xba, 0xbb, 0xdc, 0x7e, 0x5f, 0x5f, 
+	0xb3, 0x8a, 0x6a, 0xb5, 0xca, 0xbb, 0x37, 0x53, 0x42, 0xef, 0x38, 0xe8, 0x55, 0x5e, 0x03, 0x09, 
+	0x26, 0x2b, 0xe1, 0x3c, 0x10, 0xbf, 0xdf, 0xde, 0x24, 0x1f, 0xc6, 0x98, 0x16, 0x35, 0xf0, 0x3d, 
+	0x42, 0x6b, 0x8d, 0x23, 0x26, 0x8d, 0x26, 0xd0, 0xc4, 0xa3, 0x16, 0x0b, 0xaa, 0x78, 0x01, 0x7b, 
+	0x94, 0x90, 0xf4, 0x9b, 0x29, 0x43, 0x8d, 0x84, 0x42, 0x25, 0x5e, 0x0a, 0x05, 0x7c, 0x31, 0x9b, 
+	0x47, 0xab, 0x9c, 0x90, 0x14, 0xac, 0xae, 0x37, 0xeb, 0xcd, 0x1e, 0x76, 0x0a, 0x45, 0x9e, 0x0e, 
+	0x91, 0xdc, 0xd3, 0x21, 0x7c, 0x4a, 0xe3, 0xea, 0x63, 0xa9, 0xe0, 0x29, 0x29, 0xd0, 0x81, 0x24, 
+	0x34, 0x3a, 0x93, 0x46, 0x35, 0xb5, 0x5e, 0x0a, 0x85, 0x3b, 0x9d, 0x20, 0x41, 0xed, 0x33, 0x19, 
+	0x6a, 0x82, 0x5b, 0xee, 0x84, 0xcd, 0x16, 0x73, 0xfb, 0xb4, 0x2c, 0xd0, 0x5b, 0x25, 0x0e, 0x59, 
+	0xc7, 0x3c, 0xd9, 0x23, 0xc1, 0x13, 0x25, 0x3d, 0x7e, 0x44, 0x9e, 0xf2, 0x74, 0xc8, 0x9f, 0x3f, 
+	0x98, 0xe2, 0xb0, 0x7a, 0xc3, 0xc2, 0x93, 0x77, 0xb5, 0x98, 0xe8, 0x6b, 0xf0, 0x34, 0xc8, 0xfc, 
+	0x86, 0x25, 0xb2, 0xa0, 0xb1, 0x32, 0x05, 0xb7, 0xc6, 0xd3, 0x20, 0xb5, 0x0d, 0xd1, 0x9b, 0x80, 
+	0x1c, 0x48, 0x3d, 0x11, 0xb5, 0x6d, 0xc6, 0x53, 0xef, 0xb1, 0x60, 0xa1, 0xb4, 0x84, 0xca, 0xa8, 
+	0x02, 0x1c, 0xdf, 0x6c, 0x6e, 0xaf, 0x5e, 0x41, 0xe9, 0x60, 0x81, 0x5b, 0xe1, 0x7d, 0x6b, 0x5c, 
+	0x31, 0x10, 0xfb, 0xdd, 0x4b, 0xea, 0x7a, 0x04, 0xfc, 0x9f, 0xee, 0x9b, 0x87, 0x1a, 0x89, 0xed, 
+	0x85, 0x6a, 0x80, 0x5f, 0x1a, 0xad, 0x81, 0x08, 0x47, 0x25, 0x69, 0xf9, 0xa7, 0xc1, 0xdc, 0x32, 
+	0x2c, 0x38, 0x61, 0x1d, 0xb4, 0xa6, 0xf6, 0x1c, 0x0b, 0xba, 0x1b, 0x22, 0xa3, 0x99, 0xd1, 0x52, 
+	0xa1, 0x7c, 0xe4, 0x41, 0xee, 0x36, 0x60, 0x26, 0x8b, 0x78, 0x75, 0x5b, 0x77, 0x62, 0x05, 0x53, 
+	0xef, 0x8c, 0x13, 0xac, 0x40, 0xf6, 0xa3, 0x01, 0x4f, 0x86, 0x75, 0x33, 0x35, 0x3e, 0x38, 0xb8, 
+	0x37, 0x79, 0x3a, 0xd0, 0xff, 0x49, 0xe9, 0xa5, 0x43, 0x4b, 0x7f, 0x5b, 0x15, 0xfe, 0xa0, 0x25, 
+	0x2b, 0x1b, 0xdd, 0xcf, 0x93, 0x9d, 0xf3, 0x97, 0xf1, 0x51, 0x01, 0x31, 0xcf, 0x2d, 0xb8, 0xae, 
+	0x49, 0xa1, 0x25, 0xcc, 0xb4, 0x69, 0x27, 0xf1, 0x52, 0xb4, 0x22, 0xe8, 0x29, 0x81, 0x64, 0x35, 
+	0x89, 0x52, 0x8b, 0x7a, 0x17, 0xc5, 0xcb, 0x0e, 0xec, 0xf8, 0x17, 0x41, 0xd5, 0xcc, 0x99, 0x46, 
+	0x17, 0x93, 0x57, 0xbc, 0xc4, 0x0f, 0x28, 0xe0, 0x2f, 0x13, 0x8c, 0x15, 0xa3, 0xe9, 0x71, 0xb0, 
+	0x30, 0x8b, 0xd6, 0x77, 0x9b, 0x6d, 0x34, 0xed, 0x0c, 0xcf, 0x34, 0xb4, 0xec, 0xfe, 0xeb, 0xe7, 
+	0x0d, 0x08, 0x27, 0xab, 0xb5, 0x70, 0xa2, 0xf6, 0x93, 0x23, 0x58, 0x23, 0xab, 0xec, 0x4a, 0xd0, 
+	0x98, 0x79, 0xea, 0x88, 0x32, 0x37, 0x0d, 0xe5, 0x24, 0x64, 0xe5, 0xc5, 0x22, 0x9b, 0x9f, 0xe2, 
+	0x53, 0xbc, 0x2c, 0x8c, 0x6c, 0xea, 0x70, 0x8b, 0x66, 0x3b, 0xa0, 0x6b, 0x05, 0xdd, 0xf2, 0xd3, 
+	0xe1, 0xb6, 0x98, 0x44, 0xdd, 0x90, 0xa3, 0x78, 0xd6, 0x5d, 0xb6, 0xcb, 0xf1, 0x37, 0x80, 0x99, 
+	0x79, 0xbc, 0x88, 0xee, 0xc2, 0x1c, 0x71, 0x98, 0x2a, 0x89, 0x28, 0x83, 0x59, 0xb7, 0x68, 0x3c, 
+	0xe7, 0xef, 0xe7, 0x1f, 0x87, 0xd3, 0x1d, 0xfe, 0xfa, 0xc9, 0x3c, 0x6a, 0xe9, 0x8c, 0xc6, 0xe7, 
+	0xe7, 0x1e, 0x16, 0xf5, 0x46, 0x78, 0x7c, 0x40, 0x05, 0x67, 0xba, 0x83, 0xc1, 0x96, 0xe8, 0x74, 
+	0x1e, 0xe8, 0x3c, 0x1e, 0x2d, 0x1f, 0x0d, 0xf8, 0x0d, 0xfe, 0x70, 0x48, 0xdf, 0xc6, 0x03, 0x00, 
+	0x00 
 };
\ No newline at end of file
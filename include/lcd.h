@@ -0,0 +1,243 @@
+#ifndef LCD_H
+
+#define LCD_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+/*
+  HD44780 driver for the PCF8574 I2C backpack (P0 = RS, P2 = EN, P3 = backlight, P4-P7 = D4-D7)
+
+  Every nibble becomes two expander bytes (EN high, EN low) and a whole string is
+  packed in a single Wire transmission, instead of a transmission for every nibble.
+  At 400 kHz an expander byte takes ~22us, so the next nibble is always latched after
+  the 37us a character needs to be executed and no extra delays are needed.
+
+  setCursor() only sends the command if the LCD address counter isn't already there,
+  and while the cursor is hidden it's sent together with the next string.
+
+  Build with -DLCD_BENCHMARK to print the cost of the screen updates at boot,
+  tools/lcd_bench.cpp runs the same benchmark on the host with an I2C stand-in.
+*/
+
+#define LCD_RS 0x01
+#define LCD_EN 0x04
+#define LCD_BACKLIGHT 0x08
+#define LCD_I2C_CLOCK 400000
+#define LCD_UNKNOWN_ADDRESS 0xFF
+
+#ifdef BUFFER_LENGTH
+#define LCD_BUFFER_L (BUFFER_LENGTH & ~3)
+#else
+#define LCD_BUFFER_L 32
+#endif
+
+class BatchedLCD : public Print {
+public:
+  BatchedLCD(uint8_t address, uint8_t columns, uint8_t rows) : address(address), columns(columns), rows(rows) {}
+
+  void init() {
+    Wire.begin();
+    Wire.setClock(LCD_I2C_CLOCK);
+    delay(50);
+    sendRaw(0);
+    delay(1000);
+
+    // Reset sequence to be sure to be in 4 bit mode
+    for(int i = 0; i < 3; i++){
+      queueNibble(0x30, 0);
+      flushBuffer();
+      delayMicroseconds(4500);
+    }
+    queueNibble(0x20, 0);
+    flushBuffer();
+
+    command(0x28);      // 4 bit, 2 lines, 5x8 font
+    command(displayControl);
+    command(0x06);      // Left to right, no shift
+    flushBuffer();
+    clear();
+  }
+
+  void clear() {
+    command(0x01);
+    flushBuffer();
+    delayMicroseconds(2000);
+    lcdAddress = cursorAddress = 0;
+  }
+
+  void home() {
+    command(0x02);
+    flushBuffer();
+    delayMicroseconds(2000);
+    lcdAddress = cursorAddress = 0;
+  }
+
+  void setCursor(uint8_t col, uint8_t row) {
+    static const uint8_t rowOffsets[] = { 0x00, 0x40, 0x14, 0x54 };
+    if(row >= rows){
+      row = rows - 1;
+    }
+    cursorAddress = col + rowOffsets[row];
+
+    // A visible cursor must move right away
+    if(displayControl & 0x02){
+      applyCursor();
+      flushBuffer();
+    }
+  }
+
+  void cursor() {
+    applyCursor();
+    displayControl |= 0x02;
+    command(displayControl);
+    flushBuffer();
+  }
+
+  void noCursor() {
+    displayControl &= ~0x02;
+    command(displayControl);
+    flushBuffer();
+  }
+
+  void backlight() {
+    backlightValue = LCD_BACKLIGHT;
+    sendRaw(0);
+  }
+
+  void noBacklight() {
+    backlightValue = 0;
+    sendRaw(0);
+  }
+
+  void createChar(uint8_t location, const uint8_t charmap[]) {
+    command(0x40 | ((location & 0x07) << 3));
+    for(int i = 0; i < 8; i++){
+      queueByte(charmap[i], LCD_RS);
+    }
+    flushBuffer();
+
+    // The address counter now points in CGRAM
+    lcdAddress = LCD_UNKNOWN_ADDRESS;
+  }
+
+  size_t write(uint8_t value) override {
+    return write(&value, 1);
+  }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    applyCursor();
+    for(size_t i = 0; i < size; i++){
+      queueByte(buffer[i], LCD_RS);
+      lcdAddress = nextAddress(lcdAddress);
+    }
+    cursorAddress = lcdAddress;
+    flushBuffer();
+    return size;
+  }
+
+  unsigned long getBytesSent() const {
+    return bytesSent;
+  }
+
+  unsigned long getTransmissions() const {
+    return transmissions;
+  }
+
+private:
+  uint8_t address;
+  uint8_t columns;
+  uint8_t rows;
+  uint8_t backlightValue = 0;
+  uint8_t displayControl = 0x0C;    // Display on, cursor off, blink off
+  uint8_t lcdAddress = LCD_UNKNOWN_ADDRESS;
+  uint8_t cursorAddress = 0;
+
+  uint8_t buffer[LCD_BUFFER_L];
+  size_t length = 0;
+  unsigned long bytesSent = 0;
+  unsigned long transmissions = 0;
+
+  static uint8_t nextAddress(uint8_t current) {
+    if(current == LCD_UNKNOWN_ADDRESS){
+      return current;
+    }
+    current++;
+    if(current == 0x28){
+      return 0x40;
+    }else if(current == 0x68){
+      return 0x00;
+    }
+    return current;
+  }
+
+  void applyCursor() {
+    if(cursorAddress != lcdAddress){
+      command(0x80 | cursorAddress);
+      lcdAddress = cursorAddress;
+    }
+  }
+
+  void command(uint8_t value) {
+    queueByte(value, 0);
+  }
+
+  void queueByte(uint8_t value, uint8_t mode) {
+    queueNibble(value & 0xF0, mode);
+    queueNibble((value << 4) & 0xF0, mode);
+  }
+
+  void queueNibble(uint8_t nibble, uint8_t mode) {
+    if(length + 2 > sizeof(buffer)){
+      flushBuffer();
+    }
+    buffer[length++] = nibble | mode | backlightValue | LCD_EN;
+    buffer[length++] = nibble | mode | backlightValue;
+  }
+
+  void sendRaw(uint8_t value) {
+    flushBuffer();
+    buffer[length++] = value | backlightValue;
+    flushBuffer();
+  }
+
+  void flushBuffer() {
+    if(length == 0){
+      return;
+    }
+    Wire.beginTransmission(address);
+    Wire.write(buffer, length);
+    Wire.endTransmission();
+    bytesSent += length + 1;    // + the address byte
+    transmissions++;
+    length = 0;
+  }
+};
+
+#ifdef LCD_BENCHMARK
+void benchmarkLCD(BatchedLCD& lcd, uint8_t columns, uint8_t rows){
+  char line[41];
+  for(int i = 0; i < columns; i++){
+    line[i] = 'A' + i % 26;
+  }
+
+  unsigned long bytes = lcd.getBytesSent();
+  unsigned long start = micros();
+  for(int r = 0; r < rows; r++){
+    lcd.setCursor(0, r);
+    lcd.write((const uint8_t*)line, columns);
+  }
+  unsigned long elapsed = micros() - start;
+  Serial.printf("\nLCD full screen: %lu us, %lu bytes\n", elapsed, lcd.getBytesSent() - bytes);
+
+  bytes = lcd.getBytesSent();
+  start = micros();
+  lcd.setCursor(0, 0);
+  lcd.write((const uint8_t*)line, columns);
+  elapsed = micros() - start;
+  Serial.printf("LCD single row: %lu us, %lu bytes\n", elapsed, lcd.getBytesSent() - bytes);
+  lcd.clear();
+}
+#endif
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef LOG_H
+
+#define LOG_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+/*
+  Deferred log on the serial port
+
+  LOG_ERROR, LOG_WARN, LOG_INFO and LOG_DEBUG take a printf format, that stays in flash.
+  The levels above LOG_LEVEL (in secrets.h or the build flags, LOG_LEVEL_INFO if not defined)
+  compile to nothing, their arguments aren't even evaluated.
+  A message is formatted in a RAM ring buffer and loopLog() moves to the UART only the bytes
+  its FIFO can take, so logging never waits for the serial port. When the buffer is full the
+  message is dropped and counted, and the number of dropped messages is logged as soon as
+  there is room again.
+*/
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_BUFFER_L 1024
+#define LOG_MESSAGE_L 128
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) logPrintf_P(PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) do{}while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) logPrintf_P(PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) do{}while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) logPrintf_P(PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) do{}while(0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) logPrintf_P(PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) do{}while(0)
+#endif
+
+char logBuffer[LOG_BUFFER_L];
+size_t logHead = 0;       // Where the next message goes
+size_t logLength = 0;     // Bytes waiting for the UART
+uint32_t logDropped = 0;
+uint32_t logDroppedReported = 0;
+
+bool logAppend(const char* message, size_t length){
+  if(length > LOG_BUFFER_L - logLength){
+    return false;
+  }
+  size_t first = LOG_BUFFER_L - logHead < length ? LOG_BUFFER_L - logHead : length;
+  memcpy(logBuffer + logHead, message, first);
+  memcpy(logBuffer, message + first, length - first);
+  logHead = (logHead + length) % LOG_BUFFER_L;
+  logLength += length;
+  return true;
+}
+
+void logPrintf_P(PGM_P format, ...){
+  char message[LOG_MESSAGE_L];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf_P(message, sizeof(message), format, args);
+  va_end(args);
+  if(length < 0){
+    return;
+  }
+  if(length >= (int)sizeof(message)){
+    length = sizeof(message) - 1;
+    message[length - 1] = '\n';     // Truncated, the next message still starts on its own line
+  }
+  if(!logAppend(message, length)){
+    logDropped++;
+  }
+}
+
+// Writes only what the UART FIFO can take, the rest waits for the next call
+void loopLog(){
+  while(logLength > 0){
+    size_t space = Serial.availableForWrite();
+    if(space == 0){
+      return;
+    }
+    size_t tail = (logHead + LOG_BUFFER_L - logLength) % LOG_BUFFER_L;
+    size_t length = LOG_BUFFER_L - tail < logLength ? LOG_BUFFER_L - tail : logLength;
+    length = length < space ? length : space;
+    Serial.write((const uint8_t*)logBuffer + tail, length);
+    logLength -= length;
+  }
+  if(logDropped != logDroppedReported){
+    char message[48];
+    int length = snprintf(message, sizeof(message), "[%u log messages dropped]\n", logDropped - logDroppedReported);
+    if(logAppend(message, length)){
+      logDroppedReported = logDropped;
+    }
+  }
+}
+
+// Writes everything waiting, for the output that goes straight to Serial and must not cut a message
+void logFlush(){
+  while(logLength > 0){
+    loopLog();
+    yield();
+  }
+}
+
+#endif
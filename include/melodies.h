@@ -0,0 +1,89 @@
+#ifndef MELODIES_H
+
+#define MELODIES_H
+
+#include "synth.h"
+
+/*
+  Alarm sounds, in the order of the alarm sound menu
+
+  The alarm starts at ALARM_GAIN_START and gets to full volume in ALARM_RAMP_MILLIS.
+
+  This file must not depend on Arduino, the host tool in tools/ includes it too.
+*/
+
+#define ALARM_GAIN_START 40
+#define ALARM_RAMP_MILLIS 30000
+
+const SynthEnvelope beepEnvelope = { 5, 0, 255, 10 };
+const SynthEnvelope melodyEnvelope = { 10, 60, 200, 20 };
+
+const SynthNote defaultNotes[] = {
+  { 0, 1000, 5000, 0, WAVE_SQUARE, 255 }
+};
+const SynthMelody defaultMelody = { defaultNotes, 1, 1200, beepEnvelope };
+
+const SynthNote rapidFireNotes[] = {
+  { 0, 90, 5000, 0, WAVE_SQUARE, 255 }
+};
+const SynthMelody rapidFireMelody = { rapidFireNotes, 1, 100, beepEnvelope };
+
+const SynthNote unevenNotes[] = {
+  { 0, 300, 5000, 0, WAVE_SQUARE, 255 },
+  { 400, 700, 500, 0, WAVE_SQUARE, 255 }
+};
+const SynthMelody unevenMelody = { unevenNotes, 2, 1200, beepEnvelope };
+
+const SynthNote scaleNotes[] = {
+  { 220, 200, 500, 0, WAVE_TRIANGLE, 255 },
+  { 440, 200, 1000, 0, WAVE_TRIANGLE, 255 },
+  { 660, 200, 1500, 0, WAVE_TRIANGLE, 255 },
+  { 880, 200, 2000, 0, WAVE_TRIANGLE, 255 },
+  { 1100, 200, 2500, 0, WAVE_TRIANGLE, 255 },
+  { 1320, 200, 3000, 0, WAVE_TRIANGLE, 255 },
+  { 1540, 200, 3500, 0, WAVE_TRIANGLE, 255 },
+  { 1760, 200, 4000, 0, WAVE_TRIANGLE, 255 },
+  { 1980, 200, 4500, 0, WAVE_TRIANGLE, 255 },
+  { 2200, 200, 4500, 0, WAVE_TRIANGLE, 255 },
+  { 2420, 200, 4000, 0, WAVE_TRIANGLE, 255 },
+  { 2640, 200, 3500, 0, WAVE_TRIANGLE, 255 },
+  { 2860, 200, 3000, 0, WAVE_TRIANGLE, 255 },
+  { 3080, 200, 2500, 0, WAVE_TRIANGLE, 255 },
+  { 3300, 200, 2000, 0, WAVE_TRIANGLE, 255 },
+  { 3520, 200, 1500, 0, WAVE_TRIANGLE, 255 },
+  { 3740, 200, 1000, 0, WAVE_TRIANGLE, 255 },
+  { 3960, 200, 500, 0, WAVE_TRIANGLE, 255 }
+};
+const SynthMelody scaleMelody = { scaleNotes, 18, 4400, melodyEnvelope };
+
+const SynthNote doubleToneNotes[] = {
+  { 0, 200, 5000, 0, WAVE_SQUARE, 255 },
+  { 240, 200, 5000, 0, WAVE_SQUARE, 255 }
+};
+const SynthMelody doubleToneMelody = { doubleToneNotes, 2, 740, beepEnvelope };
+
+// The second voice holds the first note of every bar under the melody
+const SynthNote complexPresentsNotes[] = {
+  { 0, 200, 2500, 0, WAVE_TRIANGLE, 255 },
+  { 220, 200, 4000, 0, WAVE_TRIANGLE, 255 },
+  { 220, 860, 2000, 1, WAVE_SINE, 120 },
+  { 460, 200, 4000, 0, WAVE_TRIANGLE, 255 },
+  { 680, 200, 4500, 0, WAVE_TRIANGLE, 255 },
+  { 900, 200, 5000, 0, WAVE_TRIANGLE, 255 },
+  { 1120, 200, 4000, 0, WAVE_TRIANGLE, 255 },
+  { 1120, 860, 2000, 1, WAVE_SINE, 120 },
+  { 1340, 200, 5000, 0, WAVE_TRIANGLE, 255 },
+  { 1560, 200, 5500, 0, WAVE_TRIANGLE, 255 },
+  { 1780, 200, 6000, 0, WAVE_TRIANGLE, 255 },
+  { 2020, 200, 6000, 0, WAVE_TRIANGLE, 255 },
+  { 2020, 860, 3000, 1, WAVE_SINE, 120 },
+  { 2240, 200, 5500, 0, WAVE_TRIANGLE, 255 },
+  { 2460, 200, 5000, 0, WAVE_TRIANGLE, 255 }
+};
+const SynthMelody complexPresentsMelody = { complexPresentsNotes, 15, 2680, melodyEnvelope };
+
+const SynthMelody* const alarmMelodies[] = { &defaultMelody, &rapidFireMelody, &unevenMelody, &scaleMelody, &doubleToneMelody, &complexPresentsMelody };
+
+#define ALARM_MELODIES (sizeof(alarmMelodies) / sizeof(alarmMelodies[0]))
+
+#endif
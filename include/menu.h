@@ -25,7 +25,7 @@ public:
       }
     }
 
-    std::string getText() const {
+    const std::string& getText() const {
       return text;
     }
 
@@ -0,0 +1,383 @@
+#ifndef MQTT_H
+
+#define MQTT_H
+
+#include <Arduino.h>
+#include <functional>
+
+/*
+  MQTT client for home automation, enabled by defining MQTT_HOST in secrets.h (an IP address,
+  MQTT_PORT defaults to 1883, MQTT_USER and MQTT_PASSWORD are optional)
+
+  Every topic starts with "sveglia/<chip id>/":
+  status      retained, "online", or "offline" published by the broker as the will
+  alarm       retained, "ringing", "snoozed" or "idle"
+  next_alarm  retained, "YYYY-MM-DD HH:MM" with " skip" when it won't ring, or "none"
+  sync        retained, where the time comes from: "ntp", "fleet", "browser", "manual", "stale" or "none"
+  event       the alarm events, JSON with the UTC time they happened
+  cmd         subscribed, a line of the serial console, e.g. "dismiss", "snooze 5" or "alarm weekdays 07:30"
+  result      "OK <command>" or "ERR <command>" for every line received on cmd, followed on the
+              next lines by what the command printed, cut at MQTT_RESULT_L
+
+  loopMqtt() is a state machine: it never waits for the broker except for the TCP connection,
+  bounded by MQTT_CONNECT_TIMEOUT, and retries it with an exponential backoff. While the alarm
+  rings it's called with reconnect false, so that wait never delays the dismiss. The retained
+  topics keep only their last value and are published when it changes and after every
+  reconnection. Events wait in a RAM queue of MQTT_QUEUE_L, so the ones that happen while the
+  broker is unreachable are sent later, and the oldest are dropped when it's full.
+  The pending publishes are joined in one TCP write per loop cycle, done only when the socket
+  has room for it, so the alarm path never waits for the network. A command prints in RAM and
+  not on the serial port, and the next one is read only after its result was sent.
+*/
+
+enum MqttTopic : uint8_t {
+  MQTT_STATUS,
+  MQTT_ALARM,
+  MQTT_NEXT_ALARM,
+  MQTT_SYNC,
+  MQTT_STATE_COUNT,
+  MQTT_EVENT = MQTT_STATE_COUNT,
+  MQTT_RESULT,
+  MQTT_TOPIC_COUNT
+};
+
+#ifdef MQTT_HOST
+
+#include <ESP8266WiFi.h>
+
+#include "log.h"
+#include "mqttpacket.h"
+
+#ifndef MQTT_PORT
+#define MQTT_PORT 1883
+#endif
+#ifndef MQTT_USER
+#define MQTT_USER nullptr
+#endif
+#ifndef MQTT_PASSWORD
+#define MQTT_PASSWORD nullptr
+#endif
+#define MQTT_KEEP_ALIVE 60            // Seconds
+#define MQTT_CONNECT_TIMEOUT 500
+#define MQTT_CONNACK_TIMEOUT 5000
+#define MQTT_BACKOFF_MIN 1000
+#define MQTT_BACKOFF_MAX 300000
+#define MQTT_QUEUE_L 16
+#define MQTT_VALUE_L 64
+#define MQTT_BATCH_L 512
+#define MQTT_RESULT_L 480             // Fits in a batch with its topic
+#define MQTT_READ_L 128               // Bytes read per loop cycle
+#define MQTT_PREFIX_L 24
+
+const char* const mqttTopicNames[MQTT_TOPIC_COUNT] = {
+  "status", "alarm", "next_alarm", "sync", "event", "result"
+};
+
+enum MqttConnection : uint8_t {
+  MQTT_OFFLINE,
+  MQTT_WAIT_CONNACK,
+  MQTT_ONLINE
+};
+
+struct MqttMessage {
+  MqttTopic topic;
+  char payload[MQTT_VALUE_L];
+};
+
+WiFiClient mqttClient;
+MqttParser mqttParser;
+bool mqttEnabled = false;
+IPAddress mqttBroker;
+MqttConnection mqttConnection = MQTT_OFFLINE;
+unsigned long mqttLastAttempt = 0;
+unsigned long mqttBackoff = 0;
+unsigned long mqttLastSent = 0;
+unsigned long mqttPingSent = 0;
+bool mqttPingPending = false;
+char mqttPrefix[MQTT_PREFIX_L];
+char mqttClientId[MQTT_PREFIX_L];
+char mqttStates[MQTT_STATE_COUNT][MQTT_VALUE_L];
+bool mqttStateDirty[MQTT_STATE_COUNT];
+MqttMessage mqttQueue[MQTT_QUEUE_L];
+uint8_t mqttQueueHead = 0;
+uint8_t mqttQueueCount = 0;
+uint32_t mqttDropped = 0;
+char mqttResult[MQTT_RESULT_L];
+bool mqttResultPending = false;
+std::function<bool(char*, Print&)> mqttCommandFunc;
+
+// Keeps what a command prints, what doesn't fit is dropped
+class MqttOutput : public Print {
+public:
+  MqttOutput(char* buffer, size_t size) : buffer(buffer), size(size) {
+    buffer[0] = '\0';
+  }
+
+  size_t write(uint8_t value) override {
+    if(length == size - 1){
+      return 0;
+    }
+    buffer[length++] = value;
+    buffer[length] = '\0';
+    return 1;
+  }
+
+private:
+  char* buffer;
+  size_t size;
+  size_t length = 0;
+};
+
+void mqttTopic(char* buffer, size_t size, const char* name){
+  snprintf(buffer, size, "%s%s", mqttPrefix, name);
+}
+
+// Retained topics, published only if the value changed
+void mqttSetState(MqttTopic topic, const char* value){
+  if(strncmp(mqttStates[topic], value, MQTT_VALUE_L - 1) != 0){
+    strncpy(mqttStates[topic], value, MQTT_VALUE_L - 1);
+    mqttStateDirty[topic] = true;
+  }
+}
+
+// Not retained topics, queued until the broker can be reached
+void mqttPublish(MqttTopic topic, const char* payload){
+  if(mqttQueueCount == MQTT_QUEUE_L){
+    mqttQueueHead = (mqttQueueHead + 1) % MQTT_QUEUE_L;
+    mqttQueueCount--;
+    mqttDropped++;
+  }
+  MqttMessage& message = mqttQueue[(mqttQueueHead + mqttQueueCount) % MQTT_QUEUE_L];
+  message.topic = topic;
+  strncpy(message.payload, payload, MQTT_VALUE_L - 1);
+  message.payload[MQTT_VALUE_L - 1] = '\0';
+  mqttQueueCount++;
+}
+
+void mqttDisconnected(){
+  mqttClient.stop();
+  mqttParser.reset();
+  mqttConnection = MQTT_OFFLINE;
+  mqttLastAttempt = millis();
+  mqttBackoff = mqttBackoff == 0 ? MQTT_BACKOFF_MIN : min(mqttBackoff * 2, (unsigned long)MQTT_BACKOFF_MAX);
+  LOG_WARN("MQTT disconnected, next attempt in %lu s\n", mqttBackoff / 1000);
+}
+
+bool mqttWrite(const uint8_t* buffer, size_t length){
+  if(length == 0 || mqttClient.availableForWrite() < length){
+    return false;
+  }
+  mqttClient.write(buffer, length);
+  mqttLastSent = millis();
+  return true;
+}
+
+void mqttConnect(){
+  mqttLastAttempt = millis();
+  mqttClient.setTimeout(MQTT_CONNECT_TIMEOUT);
+  if(!mqttClient.connect(mqttBroker, MQTT_PORT)){
+    mqttDisconnected();
+    return;
+  }
+  mqttClient.setNoDelay(true);
+  char willTopic[MQTT_PREFIX_L + 8];
+  mqttTopic(willTopic, sizeof(willTopic), mqttTopicNames[MQTT_STATUS]);
+  uint8_t packet[MQTT_PACKET_L];
+  size_t length = mqttConnectPacket(packet, sizeof(packet), mqttClientId, willTopic, "offline", MQTT_USER, MQTT_PASSWORD, MQTT_KEEP_ALIVE);
+  if(!mqttWrite(packet, length)){
+    mqttDisconnected();
+    return;
+  }
+  mqttParser.reset();
+  mqttConnection = MQTT_WAIT_CONNACK;
+}
+
+void mqttConnected(){
+  char topic[MQTT_PREFIX_L + 8];
+  mqttTopic(topic, sizeof(topic), "cmd");
+  uint8_t packet[MQTT_PACKET_L];
+  if(!mqttWrite(packet, mqttSubscribePacket(packet, sizeof(packet), 1, topic))){
+    mqttDisconnected();
+    return;
+  }
+  mqttConnection = MQTT_ONLINE;
+  mqttBackoff = 0;
+  mqttPingPending = false;
+  // The broker may have the values of a previous connection, or the will
+  for(int i = 0; i < MQTT_STATE_COUNT; i++){
+    mqttStateDirty[i] = true;
+  }
+  LOG_INFO("MQTT connected\n");
+}
+
+void handleMqttCommand(){
+  const char* topic;
+  const char* payload;
+  size_t topicLength, payloadLength;
+  if(!mqttParser.publish(topic, topicLength, payload, payloadLength)){
+    return;
+  }
+  char line[MQTT_VALUE_L];
+  size_t length = payloadLength < sizeof(line) - 1 ? payloadLength : sizeof(line) - 1;
+  memcpy(line, payload, length);
+  line[length] = '\0';
+
+  char command[MQTT_VALUE_L];
+  strcpy(command, line);      // The command splits line in place
+  char printed[MQTT_RESULT_L - MQTT_VALUE_L - 4];
+  MqttOutput output(printed, sizeof(printed));
+  bool ok = mqttCommandFunc && mqttCommandFunc(line, output);
+  snprintf(mqttResult, sizeof(mqttResult), "%s %s\n%s", ok ? "OK" : "ERR", command, printed);
+  mqttResultPending = true;
+}
+
+// Reads what arrived, at most one command per loop cycle and none while a result waits
+void mqttRead(){
+  for(int i = 0; i < MQTT_READ_L && !mqttResultPending && mqttClient.available() > 0; i++){
+    if(!mqttParser.feed(mqttClient.read())){
+      if(mqttParser.malformed()){
+        LOG_ERROR("MQTT packet malformed\n");
+        mqttDisconnected();
+        return;
+      }
+      continue;
+    }
+    switch(mqttParser.type()){
+      case MQTT_CONNACK:
+        if(mqttConnection == MQTT_WAIT_CONNACK){
+          if(mqttParser.bodyLength() == 2 && mqttParser.body()[1] == 0){
+            mqttConnected();
+          }else{
+            LOG_ERROR("MQTT connection refused\n");
+            mqttDisconnected();
+            return;
+          }
+        }
+        break;
+      case MQTT_PINGRESP:
+        mqttPingPending = false;
+        break;
+      case MQTT_PUBLISH:
+        handleMqttCommand();
+        return;
+    }
+  }
+}
+
+// Joins the changed retained topics and the queued events in one write
+void mqttFlush(){
+  uint8_t batch[MQTT_BATCH_L];
+  size_t length = 0;
+  char topic[MQTT_PREFIX_L + 12];
+  bool states[MQTT_STATE_COUNT] = {};
+  for(int i = 0; i < MQTT_STATE_COUNT; i++){
+    if(!mqttStateDirty[i]){
+      continue;
+    }
+    mqttTopic(topic, sizeof(topic), mqttTopicNames[i]);
+    size_t packet = mqttPublishPacket(batch + length, sizeof(batch) - length, topic, mqttStates[i], true);
+    if(packet == 0){
+      break;
+    }
+    length += packet;
+    states[i] = true;
+  }
+  int queued = 0;
+  while(queued < mqttQueueCount){
+    const MqttMessage& message = mqttQueue[(mqttQueueHead + queued) % MQTT_QUEUE_L];
+    mqttTopic(topic, sizeof(topic), mqttTopicNames[message.topic]);
+    size_t packet = mqttPublishPacket(batch + length, sizeof(batch) - length, topic, message.payload, false);
+    if(packet == 0){
+      break;
+    }
+    length += packet;
+    queued++;
+  }
+  bool result = false;
+  if(mqttResultPending){
+    mqttTopic(topic, sizeof(topic), mqttTopicNames[MQTT_RESULT]);
+    size_t packet = mqttPublishPacket(batch + length, sizeof(batch) - length, topic, mqttResult, false);
+    length += packet;
+    result = packet > 0;
+  }
+
+  if(length == 0){
+    if(millis() - mqttLastSent > MQTT_KEEP_ALIVE * 1000UL / 2 && !mqttPingPending){
+      if(mqttWrite(batch, mqttEmptyPacket(batch, sizeof(batch), MQTT_PINGREQ))){
+        mqttPingPending = true;
+        mqttPingSent = millis();
+      }
+    }
+    return;
+  }
+  // Nothing is marked as sent until the socket takes the whole batch
+  if(!mqttWrite(batch, length)){
+    return;
+  }
+  for(int i = 0; i < MQTT_STATE_COUNT; i++){
+    mqttStateDirty[i] = mqttStateDirty[i] && !states[i];
+  }
+  mqttQueueHead = (mqttQueueHead + queued) % MQTT_QUEUE_L;
+  mqttQueueCount -= queued;
+  mqttResultPending = mqttResultPending && !result;
+}
+
+// reconnect is false where the loop can't wait for the TCP connection
+void loopMqtt(bool reconnect = true){
+  if(!mqttEnabled){
+    return;
+  }
+  if(mqttConnection != MQTT_OFFLINE && !mqttClient.connected()){
+    mqttDisconnected();
+    return;
+  }
+  switch(mqttConnection){
+    case MQTT_OFFLINE:
+      if(reconnect && WiFi.status() == WL_CONNECTED && millis() - mqttLastAttempt >= mqttBackoff){
+        mqttConnect();
+      }
+      break;
+    case MQTT_WAIT_CONNACK:
+      if(millis() - mqttLastAttempt > MQTT_CONNACK_TIMEOUT){
+        mqttDisconnected();
+      }else{
+        mqttRead();
+      }
+      break;
+    case MQTT_ONLINE:
+      if(mqttPingPending && millis() - mqttPingSent > MQTT_KEEP_ALIVE * 1000UL){
+        mqttDisconnected();
+        return;
+      }
+      mqttRead();
+      if(mqttConnection == MQTT_ONLINE){
+        mqttFlush();
+      }
+      break;
+  }
+}
+
+// commandFunc runs a line received on the cmd topic, it may change it, and prints on the Print it gets
+void setupMqtt(const std::function<bool(char*, Print&)>& commandFunc){
+  if(!mqttBroker.fromString(MQTT_HOST)){
+    LOG_ERROR("MQTT_HOST is not an IP address\n");
+    return;
+  }
+  snprintf(mqttPrefix, sizeof(mqttPrefix), "sveglia/%08x/", ESP.getChipId());
+  snprintf(mqttClientId, sizeof(mqttClientId), "sveglia-%08x", ESP.getChipId());
+  mqttCommandFunc = commandFunc;
+  memset(mqttStates, 0, sizeof(mqttStates));
+  mqttSetState(MQTT_STATUS, "online");
+  mqttEnabled = true;
+}
+
+#else
+
+void mqttSetState(MqttTopic, const char*){}
+void mqttPublish(MqttTopic, const char*){}
+void loopMqtt(bool = true){}
+void setupMqtt(const std::function<bool(char*, Print&)>&){}
+
+#endif
+
+#endif
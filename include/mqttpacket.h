@@ -0,0 +1,204 @@
+#ifndef MQTTPACKET_H
+
+#define MQTTPACKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+  MQTT 3.1.1 packets, only what the clock uses: CONNECT with a will, PUBLISH and SUBSCRIBE
+  with QoS 0, PINGREQ. The build functions write a whole packet and return its length, 0 if it
+  doesn't fit in the buffer. MqttParser gets the received bytes one at a time, so a packet can
+  arrive over many loop cycles. A remaining length of more than 4 bytes isn't MQTT: the parser
+  drops everything after it until reset(), since it can't find where the next packet starts.
+
+  This file must not depend on Arduino, the host tool in tools/ includes it too.
+*/
+
+#define MQTT_CONNECT 1
+#define MQTT_CONNACK 2
+#define MQTT_PUBLISH 3
+#define MQTT_SUBSCRIBE 8
+#define MQTT_SUBACK 9
+#define MQTT_PINGREQ 12
+#define MQTT_PINGRESP 13
+#define MQTT_DISCONNECT 14
+
+#ifndef MQTT_PACKET_L
+#define MQTT_PACKET_L 256
+#endif
+
+// Bytes of the variable length encoding of length
+size_t mqttLengthSize(size_t length){
+  size_t size = 1;
+  while(length >= 128){
+    length /= 128;
+    size++;
+  }
+  return size;
+}
+
+// Writes the fixed header, returns where the rest of the packet goes, nullptr if it doesn't fit
+uint8_t* mqttWriteHeader(uint8_t* buffer, size_t size, uint8_t header, size_t length){
+  if(1 + mqttLengthSize(length) + length > size){
+    return nullptr;
+  }
+  *buffer++ = header;
+  do{
+    uint8_t digit = length % 128;
+    length /= 128;
+    *buffer++ = length > 0 ? digit | 0x80 : digit;
+  }while(length > 0);
+  return buffer;
+}
+
+uint8_t* mqttWriteString(uint8_t* buffer, const char* text){
+  size_t length = strlen(text);
+  *buffer++ = length >> 8;
+  *buffer++ = length & 0xFF;
+  memcpy(buffer, text, length);
+  return buffer + length;
+}
+
+// The will is published retained by the broker when the connection drops, user and password can be nullptr
+size_t mqttConnectPacket(uint8_t* buffer, size_t size, const char* clientId, const char* willTopic, const char* willMessage,
+                         const char* user, const char* password, uint16_t keepAlive){
+  size_t length = 10 + 2 + strlen(clientId) + 2 + strlen(willTopic) + 2 + strlen(willMessage);
+  uint8_t flags = 0x02 | 0x04 | 0x20;   // Clean session, will, will retain
+  if(user){
+    length += 2 + strlen(user);
+    flags |= 0x80;
+  }
+  if(password){
+    length += 2 + strlen(password);
+    flags |= 0x40;
+  }
+  uint8_t* p = mqttWriteHeader(buffer, size, MQTT_CONNECT << 4, length);
+  if(!p){
+    return 0;
+  }
+  p = mqttWriteString(p, "MQTT");
+  *p++ = 4;     // 3.1.1
+  *p++ = flags;
+  *p++ = keepAlive >> 8;
+  *p++ = keepAlive & 0xFF;
+  p = mqttWriteString(p, clientId);
+  p = mqttWriteString(p, willTopic);
+  p = mqttWriteString(p, willMessage);
+  if(user){
+    p = mqttWriteString(p, user);
+  }
+  if(password){
+    p = mqttWriteString(p, password);
+  }
+  return p - buffer;
+}
+
+size_t mqttPublishPacket(uint8_t* buffer, size_t size, const char* topic, const char* payload, bool retain){
+  size_t payloadLength = strlen(payload);
+  uint8_t* p = mqttWriteHeader(buffer, size, (MQTT_PUBLISH << 4) | (retain ? 1 : 0), 2 + strlen(topic) + payloadLength);
+  if(!p){
+    return 0;
+  }
+  p = mqttWriteString(p, topic);
+  memcpy(p, payload, payloadLength);
+  return p + payloadLength - buffer;
+}
+
+size_t mqttSubscribePacket(uint8_t* buffer, size_t size, uint16_t packetId, const char* topic){
+  uint8_t* p = mqttWriteHeader(buffer, size, (MQTT_SUBSCRIBE << 4) | 0x02, 2 + 2 + strlen(topic) + 1);
+  if(!p){
+    return 0;
+  }
+  *p++ = packetId >> 8;
+  *p++ = packetId & 0xFF;
+  p = mqttWriteString(p, topic);
+  *p++ = 0;     // QoS 0
+  return p - buffer;
+}
+
+size_t mqttEmptyPacket(uint8_t* buffer, size_t size, uint8_t type){
+  uint8_t* p = mqttWriteHeader(buffer, size, type << 4, 0);
+  return p ? p - buffer : 0;
+}
+
+class MqttParser {
+public:
+  MqttParser(){ reset(); }
+
+  void reset(){
+    state = 0;
+    received = 0;
+  }
+
+  // Returns true when the byte completes a packet, that stays available until the next call.
+  // Packets longer than MQTT_PACKET_L are skipped.
+  bool feed(uint8_t byte){
+    switch(state){
+      case 0:
+        header = byte;
+        length = 0;
+        multiplier = 1;
+        received = 0;
+        state = 1;
+        return false;
+      case 1:
+        length += (byte & 0x7F) * multiplier;
+        multiplier *= 128;
+        if(byte & 0x80){
+          if(multiplier >= 128UL * 128 * 128 * 128){
+            state = 3;    // The fourth length byte says a fifth follows
+          }
+          return false;
+        }
+        state = 2;
+        return length == 0 ? complete() : false;
+      case 3:
+        return false;
+      default:
+        if(received < MQTT_PACKET_L){
+          packet[received] = byte;
+        }
+        received++;
+        return received == length ? complete() : false;
+    }
+  }
+
+  bool malformed() const { return state == 3; }
+  uint8_t type() const { return header >> 4; }
+  uint8_t flags() const { return header & 0x0F; }
+  const uint8_t* body() const { return packet; }
+  size_t bodyLength() const { return length; }
+
+  // Splits a PUBLISH in topic and payload, they aren't null terminated
+  bool publish(const char*& topic, size_t& topicLength, const char*& payload, size_t& payloadLength) const {
+    if(type() != MQTT_PUBLISH || length < 2){
+      return false;
+    }
+    topicLength = (packet[0] << 8) | packet[1];
+    size_t offset = 2 + topicLength + (((header >> 1) & 0x03) ? 2 : 0);   // QoS > 0 has a packet id
+    if(offset > length){
+      return false;
+    }
+    topic = (const char*)packet + 2;
+    payload = (const char*)packet + offset;
+    payloadLength = length - offset;
+    return true;
+  }
+
+private:
+  bool complete(){
+    state = 0;
+    return length <= MQTT_PACKET_L;
+  }
+
+  uint8_t packet[MQTT_PACKET_L];
+  uint8_t header;
+  uint8_t state;
+  size_t length;
+  size_t multiplier;
+  size_t received;
+};
+
+#endif
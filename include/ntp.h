@@ -0,0 +1,124 @@
+#ifndef NTP_H
+
+#define NTP_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "ntppacket.h"
+
+/*
+  SNTP client with millisecond precision
+
+  Unlike NTPClient it keeps the fractional part of the server timestamps and compensates
+  the network delay (include/ntppacket.h). Several samples are taken and the one with the
+  lowest delay wins, since it's the one where the delay is split most evenly between the
+  two directions.
+  The exchange never waits: ntpBegin() sends the first request and ntpPoll(), called every
+  loop cycle, reads the answer when it arrives and sends the next request, so the loop keeps
+  running for the NTP_TIMEOUT of every sample.
+  The DNS lookup does wait, up to NTP_DNS_TIMEOUT: the address is resolved by ntpResolve()
+  when the sync starts and kept for the next syncs, and forgotten when an attempt fails so
+  another server of the pool is tried.
+*/
+
+#define NTP_TIMEOUT 1000
+#define NTP_DNS_TIMEOUT 2000
+
+#define NTP_BUSY 0
+#define NTP_DONE 1
+#define NTP_FAILED 2
+
+struct NtpExchange {
+  IPAddress server;
+  int samplesLeft = 0;
+  bool found = false;
+  uint32_t nonce = 0;
+  unsigned long sent = 0;     // micros() of the request waiting for the answer
+  NtpSample best;
+};
+
+bool ntpSend(WiFiUDP& udp, NtpExchange& exchange){
+  // Answers to older requests still in the buffer are thrown away
+  while(udp.parsePacket()){
+    udp.flush();
+  }
+  uint8_t packet[NTP_PACKET_L];
+  exchange.nonce = RANDOM_REG32;
+  ntpRequestPacket(packet, exchange.nonce);
+  exchange.sent = micros();
+  udp.beginPacket(exchange.server, NTP_PORT);
+  udp.write(packet, sizeof(packet));
+  return udp.endPacket();
+}
+
+// Moves to the next sample, NTP_DONE or NTP_FAILED after the last one
+int ntpNextSample(WiFiUDP& udp, NtpExchange& exchange){
+  while(--exchange.samplesLeft > 0){
+    if(ntpSend(udp, exchange)){
+      return NTP_BUSY;
+    }
+  }
+  if(!exchange.found){
+    exchange.server = IPAddress();    // Resolved again before the next attempt
+    return NTP_FAILED;
+  }
+  return NTP_DONE;
+}
+
+// True if the exchange has an address, else resolves it waiting up to NTP_DNS_TIMEOUT
+bool ntpResolve(const char* server, NtpExchange& exchange){
+  if(exchange.server.isSet()){
+    return true;
+  }
+  IPAddress ip;
+  if(!WiFi.hostByName(server, ip, NTP_DNS_TIMEOUT)){
+    return false;
+  }
+  exchange.server = ip;
+  return true;
+}
+
+// Sends the first request to the resolved address, false if there is none
+bool ntpBegin(WiFiUDP& udp, int samples, NtpExchange& exchange){
+  if(!exchange.server.isSet()){
+    return false;
+  }
+  exchange.samplesLeft = samples + 1;
+  exchange.found = false;
+  return ntpNextSample(udp, exchange) == NTP_BUSY;
+}
+
+// The best sample is in exchange.best when it returns NTP_DONE
+int ntpPoll(WiFiUDP& udp, NtpExchange& exchange){
+  if(exchange.samplesLeft <= 0){
+    return exchange.found ? NTP_DONE : NTP_FAILED;
+  }
+  int size = udp.parsePacket();
+  if(size == NTP_PACKET_L){
+    unsigned long t4 = micros();
+    uint8_t packet[NTP_PACKET_L];
+    NtpSample sample;
+    udp.read(packet, sizeof(packet));
+    if(!ntpParseAnswer(packet, exchange.nonce, exchange.sent, t4, sample)){
+      return NTP_BUSY;    // Waits for the right answer until the timeout
+    }
+    sample.local = millis();
+    sample.server = exchange.server;
+    if(!exchange.found || sample.delay < exchange.best.delay){
+      exchange.best = sample;
+      exchange.found = true;
+    }
+    return ntpNextSample(udp, exchange);
+  }
+  if(size > 0){
+    udp.flush();
+  }
+  if(micros() - exchange.sent >= NTP_TIMEOUT * 1000UL){
+    return ntpNextSample(udp, exchange);
+  }
+  return NTP_BUSY;
+}
+
+#endif
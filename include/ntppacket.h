@@ -0,0 +1,71 @@
+#ifndef NTPPACKET_H
+
+#define NTPPACKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+  SNTP packets and the time math of the clock
+
+  With T1/T4 the local send/receive times and T2/T3 the server receive/transmit times, the
+  delay is (T4 - T1) - (T3 - T2) and at T4 the server time is T3 + delay / 2.
+  The request carries a nonce as transmit timestamp, the server sends it back as originate
+  timestamp, so a late answer to an older request isn't taken for the answer to this one.
+
+  The display ticks are scheduled on the second boundaries of the synced time.
+
+  This file must not depend on Arduino, tools/phase_error.cpp includes it too.
+*/
+
+#define NTP_PORT 123
+#define NTP_PACKET_L 48
+#define NTP_UNIX_OFFSET 2208988800UL   // Seconds from 1900 to 1970
+
+struct NtpSample {
+  uint32_t seconds;         // UTC at the local instant "local"
+  uint16_t millis;
+  unsigned long local;      // millis() when the answer arrived
+  unsigned long delay;      // Round trip delay in microseconds
+  uint32_t server;          // IPv4 address of the server that answered
+};
+
+// Milliseconds since 1900 of an NTP timestamp
+uint64_t ntpReadTimestamp(const uint8_t* p){
+  uint32_t seconds = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+  uint32_t fraction = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+  return (uint64_t)seconds * 1000 + (((uint64_t)fraction * 1000) >> 32);
+}
+
+void ntpRequestPacket(uint8_t* packet, uint32_t nonce){
+  memset(packet, 0, NTP_PACKET_L);
+  packet[0] = 0x23;     // Version 4, client mode
+  memcpy(packet + 44, &nonce, 4);
+}
+
+// t1 and t4 are the micros() of the request and of the answer, false if it isn't the answer to the request
+bool ntpParseAnswer(const uint8_t* packet, uint32_t nonce, unsigned long t1, unsigned long t4, NtpSample& sample){
+  if((packet[0] & 0x07) != 4 || packet[1] == 0 || memcmp(packet + 28, &nonce, 4) != 0){
+    return false;   // Not a server answer, kiss of death or the answer to another request
+  }
+  uint64_t t2 = ntpReadTimestamp(packet + 32);
+  uint64_t t3 = ntpReadTimestamp(packet + 40);
+  long serverMicros = (long)(t3 - t2) * 1000;
+  long roundTrip = (long)(t4 - t1) - serverMicros;
+  sample.delay = roundTrip > 0 ? roundTrip : 0;
+
+  uint64_t now = t3 + sample.delay / 2000 - (uint64_t)NTP_UNIX_OFFSET * 1000;
+  sample.seconds = now / 1000;
+  sample.millis = now % 1000;
+  return true;
+}
+
+// start is the millis() of a whole second of the synced time, returns the millis() of the
+// next tick and how many milliseconds after its second boundary the tick at now is
+unsigned long nextSecondTick(unsigned long now, unsigned long start, unsigned long& lateness){
+  lateness = (now - start) % 1000;
+  return now + 1000 - lateness;
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef OTA_H
+
+#define OTA_H
+
+#include <Arduino.h>
+#include <Updater.h>
+
+#include "log.h"
+#include "webserver.h"
+
+/*
+  Resumable firmware upload over HTTPS, used alongside ArduinoOTA
+
+  GET /ota -> "<received bytes> <total bytes>"
+  POST /ota?offset=<N>&size=<total>&md5=<hex> with a chunk of the image as multipart file
+
+  The image can be gzip compressed (gzip -9 firmware.bin), the Updater recognizes it and
+  eboot decompresses it in place at the next boot, so only the compressed bytes travel
+  and are written in flash. Every chunk is written as soon as it arrives, so when the
+  connection drops the upload restarts from the last byte received instead of from zero.
+  The MD5 of the whole image is checked before it's committed.
+  The clock keeps working between chunks.
+  Both need the credentials of the web server, a chunk without them isn't written.
+*/
+
+size_t otaOffset = 0;
+size_t otaSize = 0;
+bool otaChunkRejected = false;
+bool otaFinished = false;
+
+void handleOtaStatus(){
+    server.send(200, "text/plain", String(otaOffset) + " " + String(otaSize));
+}
+
+void handleOtaUpload(){
+    HTTPUpload& upload = server.upload();
+    if(upload.status == UPLOAD_FILE_START){
+        size_t offset = server.arg("offset").toInt();
+        otaChunkRejected = !authorized();
+        if(otaChunkRejected){
+            return;
+        }
+
+        if(offset == 0){
+            // A new upload, drop the one in progress
+            if(Update.isRunning()){
+                Update.end(false);
+            }
+            otaSize = server.arg("size").toInt();
+            otaOffset = 0;
+            otaFinished = false;
+            if(otaSize == 0 || !Update.begin(otaSize) || !Update.setMD5(server.arg("md5").c_str())){
+                LOG_ERROR("OTA begin failed: %s\n", Update.getErrorString().c_str());
+                otaChunkRejected = true;
+                otaSize = 0;
+                return;
+            }
+            LOG_INFO("Started resumable OTA\n");
+        }else if(offset != otaOffset || !Update.isRunning()){
+            otaChunkRejected = true;
+        }
+    }else if(upload.status == UPLOAD_FILE_WRITE && !otaChunkRejected){
+        if(otaOffset + upload.currentSize > otaSize || Update.write(upload.buf, upload.currentSize) != upload.currentSize){
+            otaChunkRejected = true;
+            return;
+        }
+        // Every 10%, a message per chunk would fill the log buffer
+        uint32_t step = otaOffset / (otaSize / 10 + 1);
+        otaOffset += upload.currentSize;
+        if(otaOffset / (otaSize / 10 + 1) != step){
+            LOG_DEBUG("OTA update progress: %u%%\n", otaOffset / (otaSize / 10 + 1) * 10);
+        }
+    }else if(upload.status == UPLOAD_FILE_END && !otaChunkRejected && otaOffset == otaSize){
+        // Checks the MD5 and commits the image
+        otaFinished = Update.end();
+        if(!otaFinished){
+            LOG_ERROR("OTA end failed: %s\n", Update.getErrorString().c_str());
+            otaOffset = otaSize = 0;
+        }
+    }else if(upload.status == UPLOAD_FILE_ABORTED){
+        LOG_WARN("OTA chunk aborted, waiting for it to be resent\n");
+    }
+}
+
+void handleOtaChunkDone(){
+    if(otaChunkRejected){
+        // The client can ask GET /ota where to restart from
+        server.send(409, "text/plain", String(otaOffset) + " " + String(otaSize));
+    }else if(otaFinished){
+        server.send(200, "text/plain", "OK, restarting");
+        LOG_INFO("OTA end\n");
+        logFlush();
+        delay(500);
+        ESP.restart();
+    }else if(otaSize == 0){
+        server.send(500, "text/plain", "Update failed");
+    }else{
+        server.send(200, "text/plain", String(otaOffset) + " " + String(otaSize));
+    }
+}
+
+void setupOtaServer(){
+    server.on("/ota", HTTP_GET, withAuthentication(handleOtaStatus));
+    server.on("/ota", HTTP_POST, withAuthentication(handleOtaChunkDone), handleOtaUpload);
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SCREEN_H
+
+#define SCREEN_H
+
+#include <Arduino.h>
+
+#include "lcd.h"
+#include "glyphs.h"
+#include "text.h"
+
+/*
+  The display and the clock screen, drawn without the heap: formatted text goes through a
+  LcdLine on the stack, constant text stays in flash and is centered at compile time.
+  Nothing here depends on the network, tools/render_alloc.cpp draws the clock screen on the
+  host and counts the allocations of every frame.
+*/
+
+constexpr byte columns = 20;
+constexpr byte rows = 4;
+BatchedLCD lcd(0x27, columns, rows);
+GlyphManager glyphs(lcd);
+
+const char daysOfTheWeek[7][10] PROGMEM = { "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday" };
+
+typedef FixedString<columns> LcdLine;
+
+constexpr int calculateCenterTextColumnStart(int length) {
+  return (columns - length) / 2;
+}
+
+void centerPrint(const char* text, int row = 0) {
+  size_t length = strlen(text);
+  lcd.setCursor(calculateCenterTextColumnStart(length), row);
+  lcd.write((const uint8_t*)text, length);
+}
+
+void centerPrint(const __FlashStringHelper* text, int row = 0) {
+  char line[columns + 1];
+  strncpy_P(line, (PGM_P)text, columns);
+  line[columns] = '\0';
+  centerPrint(line, row);
+}
+
+template<size_t N>
+void centerPrint(const FixedString<N>& text, int row = 0) {
+  static_assert(N <= columns, "Text is wider than the display");
+  centerPrint(text.c_str(), row);
+}
+
+// Constant text is kept in flash, and its width is checked and centered at compile time
+#define CENTER_PRINT(text, row) do { \
+    static_assert(sizeof(text) - 1 <= columns, "Text is wider than the display"); \
+    char buffer[sizeof(text)]; \
+    memcpy_P(buffer, PSTR(text), sizeof(text)); \
+    lcd.setCursor(calculateCenterTextColumnStart(sizeof(text) - 1), row); \
+    lcd.write((const uint8_t*)buffer, sizeof(text) - 1); \
+  } while(0)
+
+// Big digits are 3 chars wide, "HH:MM:SS" takes 6 * 3 + 2 = 20 columns
+void printBigTime(byte h, byte min, byte s){
+  byte values[3] = { h, min, s };
+  int col = calculateCenterTextColumnStart(20);
+  for(int i = 0; i < 3; i++){
+    printBigDigit(lcd, glyphs, values[i] / 10, col, 0);
+    printBigDigit(lcd, glyphs, values[i] % 10, col + 3, 0);
+    col += 6;
+    if(i < 2){
+      lcd.setCursor(col, 0);
+      lcd.write(0xA5);    // Middle dot
+      lcd.setCursor(col, 1);
+      lcd.write(0xA5);
+      col++;
+    }
+  }
+}
+
+// nextAlarm is day, hour and minute, with 255 as day if there is none.
+// apAddress is the address of the access point to show when there is no network, or nullptr
+void drawClockScreen(byte h, byte min, byte s, bool wifiConnected, const int nextAlarm[3], bool dismissed, const uint8_t* apAddress){
+  glyphs.beginScreen();
+  lcd.clear();
+  lcd.noCursor();
+
+  printBigTime(h, min, s);
+
+  lcd.setCursor(0, 2);
+  lcd.write(glyphs.get(wifiConnected ? GLYPH_WIFI_ON : GLYPH_WIFI_OFF));
+
+  char dayName[sizeof(daysOfTheWeek[0])];
+  if(nextAlarm[0] != 255){
+    strcpy_P(dayName, daysOfTheWeek[nextAlarm[0]]);
+  }
+  if(apAddress){
+    // The last row shows where to connect to set up the clock
+    centerPrint(LcdLine("IP: %d.%d.%d.%d", apAddress[0], apAddress[1], apAddress[2], apAddress[3]), 3);
+    if(nextAlarm[0] != 255){
+      centerPrint(LcdLine("%02d:%02d %s", nextAlarm[1], nextAlarm[2], dayName), 2);
+    }
+  }else if(nextAlarm[0] != 255){
+    CENTER_PRINT("Next alarm:", 2);
+    lcd.setCursor(columns - 1, 2);
+    lcd.write(glyphs.get(dismissed ? GLYPH_ALARM_DISMISSED : GLYPH_ALARM_ARMED));
+    centerPrint(LcdLine("%02d:%02d %s", nextAlarm[1], nextAlarm[2], dayName), 3);
+  }
+}
+
+#endif
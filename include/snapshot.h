@@ -0,0 +1,168 @@
+#ifndef SNAPSHOT_H
+
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+  -- SNAPSHOT FORMAT (little endian) --
+  0-3 (uint32): magic "SVGS"
+  4 (byte): version
+  5-6 (uint16): payload length
+  7-???: payload
+  last 4 bytes (uint32): CRC32 of everything before it
+
+  -- PAYLOAD v1 --
+  14 (byte[7][2]): alarmTimes
+  2 (byte[]): nextAlarm
+  1 (int8): nextDay
+  1 (byte): selected alarm
+  4 (int32): utc offset in seconds
+  1 (byte): consider legal hour
+  1 (byte): network count (0 or 1)
+  for every network: 1 (byte) ssid length + ssid, 1 (byte) password length + password
+
+  This file must not depend on Arduino, the host tool in tools/ includes it too.
+*/
+
+#define SNAPSHOT_MAGIC 0x53475653UL
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_SSID_L 33
+#define SNAPSHOT_PASSWD_L 65
+#define SNAPSHOT_HEADER_L 7
+#define SNAPSHOT_MAX_SIZE (SNAPSHOT_HEADER_L + 24 + 2 + (SNAPSHOT_SSID_L - 1) + (SNAPSHOT_PASSWD_L - 1) + 4)
+
+struct SettingsSnapshot {
+  uint8_t alarmTimes[7][2];
+  uint8_t nextAlarm[2];
+  int8_t nextDay;
+  uint8_t selectedAlarm;
+  int32_t utcOffset;
+  uint8_t considerLegalHour;
+  uint8_t hasNetwork;
+  char ssid[SNAPSHOT_SSID_L];
+  char passwd[SNAPSHOT_PASSWD_L];
+};
+
+uint32_t snapshotCrc32(const uint8_t* data, size_t length){
+  uint32_t crc = 0xFFFFFFFF;
+  for(size_t i = 0; i < length; i++){
+    crc ^= data[i];
+    for(int j = 0; j < 8; j++){
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static void snapshotWrite32(uint8_t* p, uint32_t value){
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+static uint32_t snapshotRead32(const uint8_t* p){
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Returns the length of the snapshot written in buffer, 0 if it doesn't fit
+size_t serializeSnapshot(const SettingsSnapshot& snapshot, uint8_t* buffer, size_t size){
+  if(size < SNAPSHOT_MAX_SIZE){
+    return 0;
+  }
+
+  size_t i = SNAPSHOT_HEADER_L;
+  memcpy(buffer + i, snapshot.alarmTimes, 14);
+  i += 14;
+  buffer[i++] = snapshot.nextAlarm[0];
+  buffer[i++] = snapshot.nextAlarm[1];
+  buffer[i++] = (uint8_t)snapshot.nextDay;
+  buffer[i++] = snapshot.selectedAlarm;
+  snapshotWrite32(buffer + i, (uint32_t)snapshot.utcOffset);
+  i += 4;
+  buffer[i++] = snapshot.considerLegalHour;
+  buffer[i++] = snapshot.hasNetwork ? 1 : 0;
+  if(snapshot.hasNetwork){
+    size_t ssidLength = strnlen(snapshot.ssid, SNAPSHOT_SSID_L - 1);
+    size_t passwdLength = strnlen(snapshot.passwd, SNAPSHOT_PASSWD_L - 1);
+    buffer[i++] = ssidLength;
+    memcpy(buffer + i, snapshot.ssid, ssidLength);
+    i += ssidLength;
+    buffer[i++] = passwdLength;
+    memcpy(buffer + i, snapshot.passwd, passwdLength);
+    i += passwdLength;
+  }
+
+  snapshotWrite32(buffer, SNAPSHOT_MAGIC);
+  buffer[4] = SNAPSHOT_VERSION;
+  buffer[5] = (i - SNAPSHOT_HEADER_L);
+  buffer[6] = (i - SNAPSHOT_HEADER_L) >> 8;
+  snapshotWrite32(buffer + i, snapshotCrc32(buffer, i));
+  return i + 4;
+}
+
+// An alarm time is HH:MM or 255:255 for off
+bool validSnapshotTime(const uint8_t time[2]){
+  return (time[0] == 255 && time[1] == 255) || (time[0] < 24 && time[1] < 60);
+}
+
+// Returns false if a field is out of range, sounds is the number of alarm sounds
+bool validSnapshotSettings(const SettingsSnapshot& snapshot, unsigned int sounds){
+  for(int i = 0; i < 7; i++){
+    if(!validSnapshotTime(snapshot.alarmTimes[i])){
+      return false;
+    }
+  }
+  if(snapshot.nextDay < -1 || snapshot.nextDay > 6 || !validSnapshotTime(snapshot.nextAlarm)){
+    return false;
+  }
+  return snapshot.selectedAlarm < sounds && snapshot.utcOffset >= -14 * 3600 && snapshot.utcOffset <= 14 * 3600 &&
+         snapshot.considerLegalHour <= 1 && snapshot.hasNetwork <= 1;
+}
+
+// Returns false if the snapshot is corrupted, truncated or of an unknown version
+bool deserializeSnapshot(const uint8_t* buffer, size_t length, SettingsSnapshot& snapshot){
+  if(length < SNAPSHOT_HEADER_L + 4 || snapshotRead32(buffer) != SNAPSHOT_MAGIC || buffer[4] != SNAPSHOT_VERSION){
+    return false;
+  }
+  size_t payloadLength = buffer[5] | (buffer[6] << 8);
+  size_t end = SNAPSHOT_HEADER_L + payloadLength;
+  if(end + 4 != length || snapshotRead32(buffer + end) != snapshotCrc32(buffer, end)){
+    return false;
+  }
+
+  size_t i = SNAPSHOT_HEADER_L;
+  if(end - i < 24){
+    return false;
+  }
+  memset(&snapshot, 0, sizeof(snapshot));
+  memcpy(snapshot.alarmTimes, buffer + i, 14);
+  i += 14;
+  snapshot.nextAlarm[0] = buffer[i++];
+  snapshot.nextAlarm[1] = buffer[i++];
+  snapshot.nextDay = (int8_t)buffer[i++];
+  snapshot.selectedAlarm = buffer[i++];
+  snapshot.utcOffset = (int32_t)snapshotRead32(buffer + i);
+  i += 4;
+  snapshot.considerLegalHour = buffer[i++];
+  snapshot.hasNetwork = buffer[i++];
+  if(snapshot.hasNetwork){
+    if(i >= end || buffer[i] >= SNAPSHOT_SSID_L || end - i - 1 < buffer[i]){
+      return false;
+    }
+    memcpy(snapshot.ssid, buffer + i + 1, buffer[i]);
+    i += buffer[i] + 1;
+    if(i >= end || buffer[i] >= SNAPSHOT_PASSWD_L || end - i - 1 < buffer[i]){
+      return false;
+    }
+    memcpy(snapshot.passwd, buffer + i + 1, buffer[i]);
+    i += buffer[i] + 1;
+  }
+
+  return i == end;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef SNTPSERVER_H
+
+#define SNTPSERVER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <functional>
+
+/*
+  SNTP server (RFC 4330) for the devices connected to the access point of the clock
+
+  It answers from the clock's own time, only reads the packets already received so it never
+  blocks, and drops the requests of a client that asks again before SNTP_MIN_INTERVAL.
+  Nothing is answered while the clock doesn't know the date. The reference id is the address
+  of the server the time came from, "LOCL" when it was set by hand or by a browser.
+
+  tools/sntp_throughput.cpp runs it on the host and measures how many requests it answers.
+*/
+
+#ifndef SNTP_PORT
+#define SNTP_PORT 123
+#endif
+#define SNTP_PACKET_L 48
+#define SNTP_MIN_INTERVAL 1000
+#define SNTP_CLIENTS 8
+#define SNTP_UNIX_OFFSET 2208988800UL   // Seconds from 1900 to 1970
+
+struct SntpClock {
+  uint32_t seconds;             // UTC
+  uint16_t millis;
+  uint32_t referenceSeconds;    // UTC of the last sync
+  uint32_t referenceAddress;    // IPv4 address of the upstream server as IPAddress stores it, 0 if none
+  uint8_t stratum;
+};
+
+struct SntpClient {
+  uint32_t ip;
+  unsigned long lastRequest;
+};
+
+WiFiUDP sntpUDP;
+bool sntpStarted = false;
+SntpClient sntpClients[SNTP_CLIENTS];
+unsigned long sntpRequests = 0;
+unsigned long sntpDropped = 0;
+std::function<bool(SntpClock&)> sntpGetClock;
+
+void sntpWriteTimestamp(uint8_t* p, uint32_t unixSeconds, uint16_t millis){
+  uint32_t seconds = unixSeconds + SNTP_UNIX_OFFSET;
+  uint32_t fraction = ((uint64_t)millis << 32) / 1000;
+  for(int i = 0; i < 4; i++){
+    p[i] = seconds >> (24 - i * 8);
+    p[i + 4] = fraction >> (24 - i * 8);
+  }
+}
+
+bool sntpRateLimited(uint32_t ip){
+  int oldest = 0;
+  for(int i = 0; i < SNTP_CLIENTS; i++){
+    if(sntpClients[i].ip == ip){
+      if(millis() - sntpClients[i].lastRequest < SNTP_MIN_INTERVAL){
+        return true;
+      }
+      sntpClients[i].lastRequest = millis();
+      return false;
+    }
+    if(sntpClients[i].lastRequest < sntpClients[oldest].lastRequest){
+      oldest = i;
+    }
+  }
+  sntpClients[oldest].ip = ip;
+  sntpClients[oldest].lastRequest = millis();
+  return false;
+}
+
+void handleSntpRequest(){
+  SntpClock received;
+  bool synced = sntpGetClock(received);
+
+  uint8_t packet[SNTP_PACKET_L];
+  if(sntpUDP.read(packet, sizeof(packet)) != SNTP_PACKET_L || (packet[0] & 0x07) != 3){
+    return;
+  }
+  sntpRequests++;
+  if(!synced || sntpRateLimited(sntpUDP.remoteIP())){
+    sntpDropped++;
+    return;
+  }
+
+  uint8_t version = (packet[0] >> 3) & 0x07;
+  uint8_t response[SNTP_PACKET_L];
+  memset(response, 0, sizeof(response));
+  response[0] = (version << 3) | 4;         // No leap second warning, server mode
+  response[1] = received.stratum;
+  response[2] = packet[2];                  // Poll interval of the client
+  response[3] = 0xF6;                       // Precision: 2^-10 s, about a millisecond
+  if(received.referenceAddress != 0){
+    memcpy(response + 12, &received.referenceAddress, 4);    // Already in network order
+  }else{
+    memcpy(response + 12, "LOCL", 4);
+  }
+  sntpWriteTimestamp(response + 16, received.referenceSeconds, 0);
+  memcpy(response + 24, packet + 40, 8);    // Originate = transmit timestamp of the client
+  sntpWriteTimestamp(response + 32, received.seconds, received.millis);
+
+  SntpClock now;
+  sntpGetClock(now);
+  sntpWriteTimestamp(response + 40, now.seconds, now.millis);
+
+  sntpUDP.beginPacket(sntpUDP.remoteIP(), sntpUDP.remotePort());
+  sntpUDP.write(response, sizeof(response));
+  sntpUDP.endPacket();
+}
+
+void loopSntpServer(){
+  bool accessPoint = WiFi.getMode() & WIFI_AP;
+  if(accessPoint && !sntpStarted){
+    sntpStarted = sntpUDP.begin(SNTP_PORT);
+  }else if(!accessPoint && sntpStarted){
+    sntpUDP.stop();
+    sntpStarted = false;
+  }
+
+  if(sntpStarted){
+    while(sntpUDP.parsePacket()){
+      handleSntpRequest();
+    }
+  }
+}
+
+void setupSntpServer(const std::function<bool(SntpClock&)>& getClock){
+  sntpGetClock = getClock;
+  memset(sntpClients, 0, sizeof(sntpClients));
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef STALL_H
+
+#define STALL_H
+
+#include <Arduino.h>
+#include <StreamString.h>
+#include <functional>
+
+#include "log.h"
+#include "webserver.h"
+
+/*
+  Detector for when loop() stops running
+
+  loop() calls stallHeartbeat() every cycle, and a timer0 interrupt every 100ms checks that it
+  did. If the heartbeat doesn't come for STALL_THRESHOLD ms, the interrupt saves the section
+  the firmware is in, the interrupted PC and the code addresses it finds on the stack in RTC
+  memory, that isn't cleared by a reset (timer1 is used by the audio output).
+  The threshold is lower than the ~3s of the software watchdog, so the record is saved
+  even when the stall ends with a reset.
+
+  The stall is reported when the loop starts again or at the next boot, on Serial,
+  in the event log and with GET /stall.
+*/
+
+enum StallSection : uint32_t {
+  STALL_LOOP,
+  STALL_SERVER,
+  STALL_NTP,
+  STALL_WIFI,
+  STALL_ALARM,
+  STALL_MENU,
+  STALL_OTA,
+  STALL_FLASH,
+  STALL_SECTION_COUNT
+};
+
+const char* const stallSectionNames[STALL_SECTION_COUNT] = {
+  "loop", "server", "ntp", "wifi", "alarm", "menu", "ota", "flash"
+};
+
+#define STALL_MAGIC 0x53544C4CUL
+#define STALL_CHECK_CYCLES (F_CPU / 10)       // 100ms
+#define STALL_THRESHOLD 2000
+#define STALL_STACK_SAMPLES 4
+#define STALL_STACK_SCAN 64
+
+// The first 128 bytes of the user RTC memory are used by eboot for the OTA updates
+#define STALL_RTC_BLOCK 32
+#define STALL_RTC_MEM ((volatile uint32_t*)(0x60001200 + STALL_RTC_BLOCK * 4))
+
+struct StallRecord {
+  uint32_t magic;
+  uint32_t section;
+  uint32_t pc;
+  uint32_t stack[STALL_STACK_SAMPLES];
+  uint32_t count;     // How many stalls since the RTC memory was cleared
+  uint32_t reported;
+};
+
+volatile uint32_t stallTicks = 0;
+volatile uint32_t stallCurrentSection = STALL_LOOP;
+volatile bool stallCaptured = false;
+StallRecord lastStall;
+bool hasLastStall = false;
+bool stallFromPreviousBoot = false;
+
+IRAM_ATTR void stallCheck(){
+  timer0_write(ESP.getCycleCount() + STALL_CHECK_CYCLES);
+  stallTicks++;
+  if(stallCaptured || stallTicks * 100 < STALL_THRESHOLD){
+    return;
+  }
+  stallCaptured = true;
+
+  volatile uint32_t* record = STALL_RTC_MEM;
+  uint32_t pc;
+  uint32_t* sp;
+  asm volatile("rsr %0, epc1" : "=a"(pc));
+  asm volatile("mov %0, a1" : "=a"(sp));
+
+  record[1] = stallCurrentSection;
+  record[2] = pc;
+
+  // Return addresses in the flash code on the interrupted stack
+  int found = 0;
+  for(int i = 0; i < STALL_STACK_SCAN && found < STALL_STACK_SAMPLES; i++){
+    uint32_t value = sp[i];
+    if(value >= 0x40200000 && value < 0x40300000){
+      record[3 + found++] = value;
+    }
+  }
+  while(found < STALL_STACK_SAMPLES){
+    record[3 + found++] = 0;
+  }
+  record[7] = record[0] == STALL_MAGIC ? record[7] + 1 : 1;
+  record[8] = 0;
+  record[0] = STALL_MAGIC;
+}
+
+// Marks what the firmware is doing until the end of the scope
+class StallScope {
+public:
+  StallScope(StallSection section) : previous(stallCurrentSection) {
+    stallCurrentSection = section;
+  }
+
+  ~StallScope() {
+    stallCurrentSection = previous;
+  }
+
+private:
+  uint32_t previous;
+};
+
+void printStall(const StallRecord& record, Print& out){
+  const char* name = record.section < STALL_SECTION_COUNT ? stallSectionNames[record.section] : "unknown";
+  out.printf("Stall in %s, PC 0x%08x, stack", name, record.pc);
+  for(int i = 0; i < STALL_STACK_SAMPLES; i++){
+    out.printf(" 0x%08x", record.stack[i]);
+  }
+  out.printf(", %u stalls\n", record.count);
+}
+
+void reportStall(std::function<void(const StallRecord&)> logFunc){
+  ESP.rtcUserMemoryRead(STALL_RTC_BLOCK, (uint32_t*)&lastStall, sizeof(lastStall));
+  if(lastStall.magic != STALL_MAGIC || lastStall.reported){
+    return;
+  }
+  hasLastStall = true;
+  logFlush();     // The report goes straight to Serial, after the messages before it
+  printStall(lastStall, Serial);
+  logFunc(lastStall);
+
+  // The record stays valid, so the next stall increments the counter
+  lastStall.reported = 1;
+  ESP.rtcUserMemoryWrite(STALL_RTC_BLOCK, (uint32_t*)&lastStall, sizeof(lastStall));
+}
+
+std::function<void(const StallRecord&)> stallLogFunc;
+
+// Must be called at every loop cycle, and in the waits that are supposed to be long
+void stallHeartbeat(){
+  stallTicks = 0;
+  if(stallCaptured){
+    reportStall(stallLogFunc);
+    stallFromPreviousBoot = false;
+    stallCaptured = false;
+  }
+}
+
+void handleStall(){
+  if(!hasLastStall){
+    server.send(200, "text/plain", "No stalls\n");
+    return;
+  }
+  StreamString text;
+  printStall(lastStall, text);
+  if(stallFromPreviousBoot){
+    text.print("The stall ended with a reset\n");
+  }
+  server.send(200, "text/plain", text);
+}
+
+void setupStallDetector(const std::function<void(const StallRecord&)>& logFunc){
+  stallLogFunc = logFunc;
+
+  // A record left by the previous boot means that the stall ended with a reset
+  reportStall(logFunc);
+  stallFromPreviousBoot = hasLastStall;
+
+  server.on("/stall", HTTP_GET, withAuthentication(handleStall));
+
+  noInterrupts();
+  timer0_isr_init();
+  timer0_attachInterrupt(stallCheck);
+  timer0_write(ESP.getCycleCount() + STALL_CHECK_CYCLES);
+  interrupts();
+}
+
+#endif
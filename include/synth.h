@@ -0,0 +1,257 @@
+#ifndef SYNTH_H
+
+#define SYNTH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+/*
+  Sample based synthesizer for the buzzer
+
+  A melody is a list of notes sorted by start time, each one played on one of the
+  SYNTH_VOICES voices with its waveform and volume, shaped by the ADSR envelope of the melody.
+  The voices are mixed in fixed point and scaled by a master gain that can ramp over time.
+
+  The ESP8266 has no hardware divider, so the divisions are only done when a note or
+  an envelope stage starts, and every sample is made of additions, shifts and multiplications.
+
+  This file must not depend on Arduino, the host tool in tools/ includes it too.
+*/
+
+#define SYNTH_SAMPLE_RATE 24000
+#define SYNTH_VOICES 2
+#define SYNTH_LEVEL_MAX (1UL << 24)
+#define SYNTH_SINE_BITS 8
+
+enum SynthWave : uint8_t {
+  WAVE_SQUARE,
+  WAVE_TRIANGLE,
+  WAVE_SAW,
+  WAVE_SINE
+};
+
+enum SynthStage : uint8_t {
+  STAGE_OFF,
+  STAGE_ATTACK,
+  STAGE_DECAY,
+  STAGE_SUSTAIN,
+  STAGE_RELEASE
+};
+
+struct SynthEnvelope {
+  uint16_t attack;      // Milliseconds
+  uint16_t decay;       // Milliseconds
+  uint8_t sustain;      // 0-255
+  uint16_t release;     // Milliseconds, after the end of the note
+};
+
+struct SynthNote {
+  uint16_t start;       // Milliseconds from the start of the melody
+  uint16_t duration;    // Milliseconds
+  uint16_t frequency;   // Hz, 0 is a rest
+  uint8_t voice;
+  uint8_t wave;
+  uint8_t volume;       // 0-255
+};
+
+struct SynthMelody {
+  const SynthNote* notes;
+  uint8_t count;
+  uint16_t length;      // Milliseconds, including the pause at the end
+  SynthEnvelope envelope;
+};
+
+struct SynthVoice {
+  uint32_t phase;
+  uint32_t step;
+  uint32_t level;       // Envelope, 0 to SYNTH_LEVEL_MAX
+  int32_t delta;        // Envelope change per sample
+  uint32_t stageLeft;   // Samples before the next envelope stage
+  uint32_t holdLeft;    // Samples before the note is released
+  uint8_t stage;
+  uint8_t wave;
+  uint8_t volume;
+};
+
+int16_t synthSine[1 << SYNTH_SINE_BITS];
+
+uint32_t synthSamples(uint32_t millis){
+  return millis * (SYNTH_SAMPLE_RATE / 1000);
+}
+
+class Synth {
+public:
+  Synth() : melody(nullptr), time(0), nextNote(0), gain(SYNTH_LEVEL_MAX), gainDelta(0), gainLeft(0) {
+    for(int i = 0; i < (1 << SYNTH_SINE_BITS); i++){
+      synthSine[i] = 32767 * sin(2 * M_PI * i / (1 << SYNTH_SINE_BITS));
+    }
+    for(int i = 0; i < SYNTH_VOICES; i++){
+      voices[i].stage = STAGE_OFF;
+    }
+  }
+
+  void play(const SynthMelody& newMelody){
+    melody = &newMelody;
+    time = 0;
+    nextNote = 0;
+  }
+
+  void stop(){
+    melody = nullptr;
+    for(int i = 0; i < SYNTH_VOICES; i++){
+      voices[i].stage = STAGE_OFF;
+    }
+  }
+
+  // False when the melody got to its end, the release of the last notes can still be playing
+  bool isPlaying() const {
+    return melody != nullptr && time < synthSamples(melody->length);
+  }
+
+  // The gain goes from "from" to "to" (0-255) in "millis"
+  void setGainRamp(uint8_t from, uint8_t to, uint32_t millis){
+    gain = (uint32_t)from << 16;
+    gainLeft = synthSamples(millis);
+    gainDelta = gainLeft > 0 ? ((int32_t)to - from) * 65536 / (int32_t)gainLeft : 0;
+    if(gainLeft == 0){
+      gain = (uint32_t)to << 16;
+    }
+  }
+
+  void render(int16_t* out, size_t count){
+    for(size_t i = 0; i < count; i++){
+      startNotes();
+
+      int32_t mix = 0;
+      for(int v = 0; v < SYNTH_VOICES; v++){
+        SynthVoice& voice = voices[v];
+        if(voice.stage == STAGE_OFF){
+          continue;
+        }
+        int32_t amplitude = ((voice.level >> 16) * voice.volume) >> 8;
+        mix += (wave(voice) * amplitude) >> 8;
+        voice.phase += voice.step;
+        advanceEnvelope(voice);
+      }
+
+      mix = (mix * (int32_t)(gain >> 16)) >> 8;
+      if(gainLeft > 0){
+        gain += gainDelta;
+        gainLeft--;
+      }
+      out[i] = mix > 32767 ? 32767 : (mix < -32767 ? -32767 : mix);
+      time++;
+    }
+  }
+
+private:
+  const SynthMelody* melody;
+  uint32_t time;
+  uint8_t nextNote;
+  SynthVoice voices[SYNTH_VOICES];
+  uint32_t gain;
+  int32_t gainDelta;
+  uint32_t gainLeft;
+
+  static int32_t wave(const SynthVoice& voice){
+    switch(voice.wave){
+      case WAVE_SQUARE:
+        return voice.phase & 0x80000000 ? 32767 : -32767;
+      case WAVE_TRIANGLE: {
+        uint32_t position = voice.phase >> 15;
+        return (int32_t)(position < 65536 ? position : 131071 - position) - 32768;
+      }
+      case WAVE_SAW:
+        return (int32_t)(voice.phase >> 16) - 32768;
+      default:
+        return synthSine[voice.phase >> (32 - SYNTH_SINE_BITS)];
+    }
+  }
+
+  void startNotes(){
+    if(melody == nullptr){
+      return;
+    }
+    while(nextNote < melody->count && synthSamples(melody->notes[nextNote].start) <= time){
+      const SynthNote& note = melody->notes[nextNote++];
+      if(note.frequency == 0 || note.voice >= SYNTH_VOICES){
+        continue;
+      }
+      SynthVoice& voice = voices[note.voice];
+      voice.phase = 0;
+      voice.step = ((uint64_t)note.frequency << 32) / SYNTH_SAMPLE_RATE;
+      voice.wave = note.wave;
+      voice.volume = note.volume;
+      voice.level = 0;
+      voice.holdLeft = synthSamples(note.duration);
+      enterStage(voice, STAGE_ATTACK);
+    }
+  }
+
+  // Sets the per sample change to reach the target of the stage in its duration
+  void enterStage(SynthVoice& voice, uint8_t stage){
+    const SynthEnvelope& envelope = melody->envelope;
+    uint32_t sustain = (uint32_t)envelope.sustain << 16;
+    uint32_t target = 0;
+    voice.stage = stage;
+    switch(stage){
+      case STAGE_ATTACK:
+        voice.stageLeft = synthSamples(envelope.attack);
+        target = SYNTH_LEVEL_MAX;
+        break;
+      case STAGE_DECAY:
+        voice.stageLeft = synthSamples(envelope.decay);
+        target = sustain;
+        break;
+      case STAGE_SUSTAIN:
+        voice.stageLeft = 0;
+        voice.delta = 0;
+        return;
+      case STAGE_RELEASE:
+        voice.stageLeft = synthSamples(envelope.release);
+        target = 0;
+        break;
+      default:
+        return;
+    }
+    if(voice.stageLeft == 0){
+      voice.level = target;
+      voice.delta = 0;
+    }else{
+      voice.delta = ((int32_t)target - (int32_t)voice.level) / (int32_t)voice.stageLeft;
+    }
+  }
+
+  void advanceEnvelope(SynthVoice& voice){
+    voice.level += voice.delta;
+    if(voice.holdLeft > 0 && --voice.holdLeft == 0){
+      enterStage(voice, STAGE_RELEASE);
+      if(voice.stageLeft == 0){
+        voice.stage = STAGE_OFF;
+      }
+      return;
+    }
+    if(voice.stage == STAGE_SUSTAIN || (voice.stageLeft > 0 && --voice.stageLeft > 0)){
+      return;
+    }
+    switch(voice.stage){
+      case STAGE_ATTACK:
+        voice.level = SYNTH_LEVEL_MAX;
+        enterStage(voice, STAGE_DECAY);
+        if(voice.stageLeft == 0){
+          enterStage(voice, STAGE_SUSTAIN);
+        }
+        break;
+      case STAGE_DECAY:
+        enterStage(voice, STAGE_SUSTAIN);
+        break;
+      case STAGE_RELEASE:
+        voice.level = 0;
+        voice.stage = STAGE_OFF;
+        break;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef TELEMETRY_H
+
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+/*
+  Telemetry pushed to a StatsD collector, enabled by defining TELEMETRY_HOST in secrets.h
+  (an IP address, TELEMETRY_PORT defaults to 8125)
+
+  Counters and histograms are accumulated in RAM and every TELEMETRY_INTERVAL the values are
+  copied and the accumulators start again. The lines are then sent a datagram per loop cycle,
+  so a loop never formats or sends more than TELEMETRY_PACKET_L bytes. UDP doesn't wait for
+  the collector, and when WiFi is down the batch is dropped instead of kept for later.
+
+  The histograms have power of two buckets: bucket 0 counts the zeros and bucket i the values
+  from 2^(i-1) to 2^i - 1, the last one every value above. They aren't cumulative: they are
+  sent as <name>.lt_<2^i> counters of their own values only, plus count, sum and max.
+
+  Every metric is prefixed with "sveglia.<chip id>.", e.g. "sveglia.00a1b2c3.ntp_syncs:1|c".
+*/
+
+enum TelemetryCounter : uint8_t {
+  TM_ALARMS_FIRED,
+  TM_ALARMS_SKIPPED,
+  TM_ALARMS_MISSED,
+  TM_NTP_SYNCS,
+  TM_NTP_RETRIES,
+  TM_WIFI_DISCONNECTS,
+  TM_STALLS,
+  TM_BATCHES_DROPPED,
+  TM_COUNTER_COUNT
+};
+
+enum TelemetryHistogram : uint8_t {
+  TM_LOOP_MICROS,
+  TM_TICK_LATENESS,       // Milliseconds
+  TM_NTP_CORRECTION,      // Milliseconds, absolute value
+  TM_ALARM_LATENCY,       // Seconds before the alarm was dismissed
+  TM_ALARM_LATENESS,      // Milliseconds from the deadline to when the alarm started ringing
+  TM_HISTOGRAM_COUNT
+};
+
+#ifdef TELEMETRY_HOST
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "log.h"
+
+#ifndef TELEMETRY_PORT
+#define TELEMETRY_PORT 8125
+#endif
+#define TELEMETRY_INTERVAL 10000
+#define TELEMETRY_PACKET_L 512
+#define TELEMETRY_LINE_L 64
+#define TELEMETRY_BUCKETS 17
+
+const char* const telemetryCounterNames[TM_COUNTER_COUNT] = {
+  "alarms_fired", "alarms_skipped", "alarms_missed", "ntp_syncs", "ntp_retries", "wifi_disconnects", "stalls", "batches_dropped"
+};
+
+const char* const telemetryHistogramNames[TM_HISTOGRAM_COUNT] = {
+  "loop_us", "tick_lateness_ms", "ntp_correction_ms", "alarm_latency_s", "alarm_lateness_ms"
+};
+
+struct TelemetryHistogramData {
+  uint32_t buckets[TELEMETRY_BUCKETS];
+  uint32_t count;
+  uint32_t sum;
+  uint32_t max;
+};
+
+struct TelemetryData {
+  uint32_t counters[TM_COUNTER_COUNT];
+  TelemetryHistogramData histograms[TM_HISTOGRAM_COUNT];
+  uint32_t freeHeap;
+  int32_t rssi;
+  uint32_t uptime;
+};
+
+// The lines of a batch: counters, then for every histogram the buckets, count, sum and max, then the gauges
+#define TELEMETRY_HISTOGRAM_LINES (TELEMETRY_BUCKETS + 3)
+#define TELEMETRY_GAUGE_LINES 3
+#define TELEMETRY_LINES (TM_COUNTER_COUNT + TM_HISTOGRAM_COUNT * TELEMETRY_HISTOGRAM_LINES + TELEMETRY_GAUGE_LINES)
+
+WiFiUDP telemetryUDP;
+bool telemetryEnabled = false;
+IPAddress telemetryCollector;
+TelemetryData telemetryCurrent;
+TelemetryData telemetryBatch;
+int telemetryNextLine = -1;      // -1 when there is no batch to send
+unsigned long telemetryLastBatch = 0;
+char telemetryPrefix[20];
+
+void telemetryAdd(TelemetryCounter counter, uint32_t value = 1){
+  telemetryCurrent.counters[counter] += value;
+}
+
+void telemetryObserve(TelemetryHistogram histogram, uint32_t value){
+  TelemetryHistogramData& data = telemetryCurrent.histograms[histogram];
+  int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+  data.buckets[bucket < TELEMETRY_BUCKETS ? bucket : TELEMETRY_BUCKETS - 1]++;
+  data.count++;
+  data.sum += value;
+  if(value > data.max){
+    data.max = value;
+  }
+}
+
+// Returns the length of the line, 0 if there's nothing to send for it
+int formatTelemetryLine(int line, char* buffer, size_t size){
+  const TelemetryData& data = telemetryBatch;
+  if(line < TM_COUNTER_COUNT){
+    return data.counters[line] ? snprintf(buffer, size, "%s%s:%u|c\n", telemetryPrefix, telemetryCounterNames[line], data.counters[line]) : 0;
+  }
+  line -= TM_COUNTER_COUNT;
+  if(line < TM_HISTOGRAM_COUNT * TELEMETRY_HISTOGRAM_LINES){
+    const char* name = telemetryHistogramNames[line / TELEMETRY_HISTOGRAM_LINES];
+    const TelemetryHistogramData& histogram = data.histograms[line / TELEMETRY_HISTOGRAM_LINES];
+    int index = line % TELEMETRY_HISTOGRAM_LINES;
+    if(histogram.count == 0){
+      return 0;
+    }
+    if(index < TELEMETRY_BUCKETS - 1){
+      return histogram.buckets[index] ? snprintf(buffer, size, "%s%s.lt_%lu:%u|c\n", telemetryPrefix, name, 1UL << index, histogram.buckets[index]) : 0;
+    }
+    switch(index - TELEMETRY_BUCKETS + 1){
+      case 0:
+        return histogram.buckets[index] ? snprintf(buffer, size, "%s%s.lt_inf:%u|c\n", telemetryPrefix, name, histogram.buckets[index]) : 0;
+      case 1:
+        return snprintf(buffer, size, "%s%s.count:%u|c\n", telemetryPrefix, name, histogram.count);
+      case 2:
+        return snprintf(buffer, size, "%s%s.sum:%u|c\n", telemetryPrefix, name, histogram.sum);
+      default:
+        return snprintf(buffer, size, "%s%s.max:%u|g\n", telemetryPrefix, name, histogram.max);
+    }
+  }
+  line -= TM_HISTOGRAM_COUNT * TELEMETRY_HISTOGRAM_LINES;
+  switch(line){
+    case 0:
+      return snprintf(buffer, size, "%sfree_heap:%u|g\n", telemetryPrefix, data.freeHeap);
+    case 1:
+      return snprintf(buffer, size, "%srssi:%d|g\n", telemetryPrefix, data.rssi);
+    default:
+      return snprintf(buffer, size, "%suptime_s:%u|g\n", telemetryPrefix, data.uptime);
+  }
+}
+
+// Sends the next datagram of the batch
+void sendTelemetryPacket(){
+  char packet[TELEMETRY_PACKET_L];
+  size_t length = 0;
+  while(telemetryNextLine < TELEMETRY_LINES){
+    char line[TELEMETRY_LINE_L];
+    int lineLength = formatTelemetryLine(telemetryNextLine, line, sizeof(line));
+    if(lineLength >= (int)sizeof(line)){
+      lineLength = 0;     // Truncated, it wouldn't be parsed
+    }
+    if(length + lineLength > sizeof(packet)){
+      break;
+    }
+    memcpy(packet + length, line, lineLength);
+    length += lineLength;
+    telemetryNextLine++;
+  }
+  if(telemetryNextLine == TELEMETRY_LINES){
+    telemetryNextLine = -1;
+  }
+  if(length > 0){
+    telemetryUDP.beginPacket(telemetryCollector, TELEMETRY_PORT);
+    telemetryUDP.write((const uint8_t*)packet, length);
+    telemetryUDP.endPacket();
+  }
+}
+
+void loopTelemetry(){
+  if(!telemetryEnabled){
+    return;
+  }
+  if(millis() - telemetryLastBatch >= TELEMETRY_INTERVAL){
+    telemetryLastBatch = millis();
+    if(WiFi.status() != WL_CONNECTED || telemetryNextLine != -1){
+      // Nothing is kept for later, only the number of lost batches
+      uint32_t dropped = telemetryCurrent.counters[TM_BATCHES_DROPPED];
+      memset(&telemetryCurrent, 0, sizeof(telemetryCurrent));
+      telemetryCurrent.counters[TM_BATCHES_DROPPED] = dropped + 1;
+      telemetryNextLine = -1;
+      return;
+    }
+    telemetryBatch = telemetryCurrent;
+    telemetryBatch.freeHeap = ESP.getFreeHeap();
+    telemetryBatch.rssi = WiFi.RSSI();
+    telemetryBatch.uptime = millis() / 1000;
+    memset(&telemetryCurrent, 0, sizeof(telemetryCurrent));
+    telemetryNextLine = 0;
+  }
+
+  if(telemetryNextLine != -1){
+    if(WiFi.status() != WL_CONNECTED){
+      telemetryNextLine = -1;
+      telemetryCurrent.counters[TM_BATCHES_DROPPED]++;
+      return;
+    }
+    sendTelemetryPacket();
+  }
+}
+
+void setupTelemetry(){
+  if(!telemetryCollector.fromString(TELEMETRY_HOST)){
+    LOG_ERROR("TELEMETRY_HOST is not an IP address\n");
+    return;
+  }
+  snprintf(telemetryPrefix, sizeof(telemetryPrefix), "sveglia.%08x.", ESP.getChipId());
+  memset(&telemetryCurrent, 0, sizeof(telemetryCurrent));
+  telemetryLastBatch = millis();
+  telemetryEnabled = true;
+}
+
+#else
+
+void telemetryAdd(TelemetryCounter, uint32_t = 1){}
+void telemetryObserve(TelemetryHistogram, uint32_t){}
+void loopTelemetry(){}
+void setupTelemetry(){}
+
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TEXT_H
+
+#define TEXT_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Text with a fixed capacity that lives on the stack, longer text is truncated instead of allocating
+template<size_t N>
+class FixedString {
+public:
+  FixedString() {
+    buffer[0] = '\0';
+  }
+
+  FixedString(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+  }
+
+  const char* c_str() const {
+    return buffer;
+  }
+
+  size_t length() const {
+    return strlen(buffer);
+  }
+
+  static constexpr size_t capacity() {
+    return N;
+  }
+
+private:
+  char buffer[N + 1];
+};
+
+#endif
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
@@ -6,10 +8,40 @@
 
 #include "sslcert.h"
 #include "html_index.h"
+#include "snapshot.h"
+
+/*
+  The server also answers in station mode, where every host of the LAN can reach it, so the
+  page and every route that changes or shows the state of the clock need the HTTP credentials:
+  user WEB_USER, password WEB_PASSWORD (the password of the hotspot if not set in secrets.h).
+  Only /ping is open, it has no effect, and port 80 only redirects to HTTPS.
+*/
+
+#ifndef WEB_USER
+#define WEB_USER "sveglia"
+#endif
+#ifndef WEB_PASSWORD
+#define WEB_PASSWORD AP_PASSWD
+#endif
 
 BearSSL::ESP8266WebServerSecure server(443);
 ESP8266WebServer serverHTTP(80);
 
+bool authorized(){
+    return server.authenticate(WEB_USER, WEB_PASSWORD);
+}
+
+// The handler runs only with the right credentials, the browser is asked for them otherwise
+std::function<void()> withAuthentication(const std::function<void()>& handler){
+    return [handler](){
+        if(!authorized()){
+            server.requestAuthentication(BASIC_AUTH, "Sveglia");
+            return;
+        }
+        handler();
+    };
+}
+
 void page(){
     server.sendHeader("Content-Encoding", "gzip");
     server.send(200, "text/html", html_index, html_index_L);
@@ -38,16 +70,82 @@ void handleSetWifi(const std::function<boolean(String, String)>& setWifiFunc){
     }
 }
 
-void setupServer(const std::function<void()>& connectWifi, const std::function<boolean(String, String)>& setWifiFunc){
+void handleExportSnapshot(const std::function<size_t(uint8_t*, size_t)>& exportFunc){
+    uint8_t buffer[SNAPSHOT_MAX_SIZE];
+    size_t length = exportFunc(buffer, sizeof(buffer));
+    if(length == 0){
+        server.send(500, "text/plain", "Could not create the snapshot");
+        return;
+    }
+    server.sendHeader("Content-Disposition", "attachment; filename=\"sveglia.bin\"");
+    server.send(200, "application/octet-stream", (const char*)buffer, length);
+}
+
+// The snapshot is uploaded as a multipart file, so the binary data is never handled as a String
+uint8_t snapshotUploadBuffer[SNAPSHOT_MAX_SIZE];
+size_t snapshotUploadLength = 0;
+bool snapshotUploadOverflow = false;
+
+void handleSnapshotUpload(){
+    HTTPUpload& upload = server.upload();
+    if(upload.status == UPLOAD_FILE_START){
+        snapshotUploadLength = 0;
+        snapshotUploadOverflow = !authorized();    // Nothing is kept, the request will be refused
+    }else if(upload.status == UPLOAD_FILE_WRITE){
+        if(snapshotUploadLength + upload.currentSize > sizeof(snapshotUploadBuffer)){
+            snapshotUploadOverflow = true;
+        }else{
+            memcpy(snapshotUploadBuffer + snapshotUploadLength, upload.buf, upload.currentSize);
+            snapshotUploadLength += upload.currentSize;
+        }
+    }
+}
+
+void handleImportSnapshot(const std::function<bool(const uint8_t*, size_t)>& importFunc){
+    if(snapshotUploadOverflow || snapshotUploadLength == 0){
+        server.send(400, "text/plain", "Invalid snapshot");
+    }else if(importFunc(snapshotUploadBuffer, snapshotUploadLength)){
+        server.send(200, "text/plain", "OK");
+    }else{
+        server.send(400, "text/plain", "Invalid snapshot");
+    }
+    snapshotUploadLength = 0;
+}
+
+void setupServer(const std::function<void()>& connectWifi, const std::function<boolean(String, String)>& setWifiFunc,
+                 const std::function<size_t(uint8_t*, size_t)>& exportFunc, const std::function<bool(const uint8_t*, size_t)>& importFunc){
     serverHTTP.on("/", secureRedirect);
     serverHTTP.begin();
 
     server.getServer().setRSACert(new BearSSL::X509List(serverCert), new BearSSL::PrivateKey(serverKey));
-    server.on("/", page);
-    server.on("/setWifi", HTTP_POST, [setWifiFunc](){handleSetWifi(setWifiFunc);});
+    server.on("/", withAuthentication(page));
+    server.on("/setWifi", HTTP_POST, withAuthentication([setWifiFunc](){handleSetWifi(setWifiFunc);}));
+    server.on("/snapshot", HTTP_GET, withAuthentication([exportFunc](){handleExportSnapshot(exportFunc);}));
+    server.on("/snapshot", HTTP_POST, withAuthentication([importFunc](){handleImportSnapshot(importFunc);}), handleSnapshotUpload);
     server.begin();
 }
 
+// The browser sends its UTC time in milliseconds and the round trip time of a /ping.
+// Without force=1 it's refused when the clock is already synced
+void handleSetTime(const std::function<bool(uint64_t, unsigned long)>& setTimeFunc, const std::function<bool()>& syncedFunc){
+    String epoch = server.arg("epoch");
+    String rtt = server.arg("rtt");
+    if(epoch == "" || rtt == ""){
+        server.send(400, "text/plain", "Missing parameters");
+    }else if(server.arg("force") != "1" && syncedFunc()){
+        server.send(409, "text/plain", "Already synced");
+    }else if(setTimeFunc(strtoull(epoch.c_str(), nullptr, 10), rtt.toInt())){
+        server.send(200, "text/plain", "OK");
+    }else{
+        server.send(400, "text/plain", "Invalid time");
+    }
+}
+
+void setupSetTimeServer(const std::function<bool(uint64_t, unsigned long)>& setTimeFunc, const std::function<bool()>& syncedFunc){
+    server.on("/ping", [](){server.send(204);});
+    server.on("/setTime", HTTP_POST, withAuthentication([setTimeFunc, syncedFunc](){handleSetTime(setTimeFunc, syncedFunc);}));
+}
+
 void loopServer(){
     serverHTTP.handleClient();
     server.handleClient();
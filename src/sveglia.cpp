@@ -9,8 +9,6 @@
 #define DT D6
 #define CLK D5
 
-#include <LiquidCrystal_I2C.h>
-#include <NTPClient.h>
 #include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
 #include <EEPROM.h>
@@ -20,16 +18,36 @@
 #include <ESP8266mDNS.h>
 
 #include "secrets.h"
+#include "log.h"
+#include "lcd.h"
+#include "glyphs.h"
+#include "text.h"
+#include "screen.h"
+#include "ntp.h"
 #include "menu.h"
 #include "alarms.h"
+#include "snapshot.h"
 #include "webserver.h"
-
-const char* SSID = SECRET_SSID;
-const char* PASSWD = SECRET_PASSWD;
+#include "ota.h"
+#include "eventlog.h"
+#include "fleet.h"
+#include "sntpserver.h"
+#include "stall.h"
+#include "holidays.h"
+#include "telemetry.h"
+#include "encoder.h"
+#include "deadline.h"
+#include "console.h"
+#include "mqtt.h"
+#include "discovery.h"
+
+char SSID[SNAPSHOT_SSID_L] = SECRET_SSID;
+char PASSWD[SNAPSHOT_PASSWD_L] = SECRET_PASSWD;
+bool networkOverride = false;
 
 // Time zone offset
-const long utcOffsetInSeconds = 3600;
-const bool considerLegalHour = true;
+long utcOffsetInSeconds = 3600;
+bool considerLegalHour = true;
 
 // Global time variables
 byte seconds = 0;
@@ -38,9 +56,23 @@ byte hours = 0;
 byte day = 0;
 unsigned long ntpEpochTime;
 unsigned long ntpStart;
+long legalHourOffset = 0;      // Seconds added to the epoch for the hours on the display
 bool timeSetManually = false;
+byte prevSeconds = -1;
+const char* syncSource = "none";
+uint32_t syncServer = 0;       // IPv4 address of the server of the last sync, 0 if it wasn't from a server
+unsigned long lastSyncMillis = 0;
+#define SYNC_STALE_MILLIS (1000UL * 60 * 60)     // The time is "stale" after an hour without syncs
+
+// Local time in seconds, 0 if it was never synced
+unsigned long currentEpochTime(){
+  return ntpEpochTime ? ntpEpochTime + (millis() - ntpStart) / 1000 : 0;
+}
 
-char daysOfTheWeek[7][12] = { "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday" };
+// Milliseconds since 1970 of the time on the display, with the legal hour, 0 if it was never set
+uint64_t wallClockMillis(){
+  return ntpEpochTime ? ((uint64_t)ntpEpochTime + legalHourOffset) * 1000 + (millis() - ntpStart) : 0;
+}
 
 // For unset hour set to 255
 byte alarmTimes[7][2] = { {255,255}, {255,255}, {255,255}, {255,255}, {255,255}, {255,255}, {255,255} };
@@ -48,17 +80,16 @@ byte nextAlarm[2] = {255, 255};
 int nextDay = -1;
 
 bool dismissNextAlarm = false;
-bool alarmSounded = false;
 int selectedAlarm = 0;
 
 // Define NTP Client to get time
 WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP, "europe.pool.ntp.org", utcOffsetInSeconds);
+const char* ntpServer = "europe.pool.ntp.org";
+const int ntpLocalPort = 2390;
+const int ntpSamples = 4;
+#define NTP_RETRY_MILLIS 1000
 
 // LCD setup
-const byte columns = 20;
-const byte rows = 4;
-LiquidCrystal_I2C lcd(0x27, columns, rows);
 byte isBacklightOn = 0;
 long long int backlightTimer = millis();
 
@@ -68,9 +99,19 @@ int currentMenuLength;
 int menuOption = 0;
 int firstMenuOption = 0;
 byte isMenuOpen = false;
-int genericCouter;
 bool genericCount = false;
-bool genericDelay = false;
+
+// Encoder steps while entering a value, queued by the interrupt with their time
+#define ENCODER_QUEUE 16
+#define ENCODER_DEBOUNCE 3
+struct EncoderEvent {
+  uint32_t time;
+  int8_t direction;
+};
+volatile EncoderEvent encoderQueue[ENCODER_QUEUE];
+volatile uint8_t encoderHead = 0;
+volatile uint8_t encoderTail = 0;
+volatile unsigned long encoderLastEdge = 0;
 bool notConnectedMode = false;
 
 //
@@ -82,13 +123,20 @@ bool notConnectedMode = false;
   0 (byte): EEPROM init value
   1-16 (byte[]): alarmTimes
   17-19 (byte[]): nextAlarm
-  20-24 (int): nextDay
-  24-28(int): selected alarm
+  20-23 (int): nextDay
+  24-27 (int): selected alarm
   29 (byte): networkOverride
-  29-???: networkOverrideSettings
+  30-62 (char[]): network SSID
+  63-127 (char[]): network password
+  128 (byte): timezone init value
+  129-132 (long): utcOffsetInSeconds
+  133 (bool): considerLegalHour
+  134-137 (uint32): fleet config version
 
 */
 
+const int EEPROMSize = 256;
+
 // 79 is a random prime number check
 const byte EEPROMCheckValue = 79;
 
@@ -101,16 +149,59 @@ void generalSaveCheck(){
 }
 
 bool saveAlarmsToEEPROM(){
+  logEvent(EVENT_CONFIG_CHANGED, CONFIG_ALARMS);
   generalSaveCheck();
   EEPROM.put(1, alarmTimes);
   EEPROM.put(17, nextAlarm);
   EEPROM.put(20, nextDay);
+  alarmScheduleChanged = true;
   return EEPROM.commit();
 }
 
 bool saveAlarmThemeToEEPROM(){
+  logEvent(EVENT_CONFIG_CHANGED, CONFIG_SOUND);
+  generalSaveCheck();
+  EEPROM.put(24, selectedAlarm);
+  return EEPROM.commit();
+}
+
+void putNetworkToEEPROM(){
+  EEPROM.put(29, (byte)networkOverride);
+  EEPROM.put(30, SSID);
+  EEPROM.put(63, PASSWD);
+}
+
+void putTimezoneToEEPROM(){
+  EEPROM.put(128, EEPROMCheckValue);
+  EEPROM.put(129, utcOffsetInSeconds);
+  EEPROM.put(133, considerLegalHour);
+}
+
+uint32_t configVersion = 0;
+
+// Must be called before saving a change to the alarms or the alarm sound made on this clock
+void alarmConfigChanged(){
+  configVersion = fleetConfigChanged();
+  EEPROM.put(134, configVersion);
+}
+
+bool saveNetworkToEEPROM(){
+  logEvent(EVENT_CONFIG_CHANGED, CONFIG_NETWORK);
+  generalSaveCheck();
+  putNetworkToEEPROM();
+  return EEPROM.commit();
+}
+
+// Everything is written in the RAM copy first so the flash is written only once
+bool saveAllToEEPROM(){
   generalSaveCheck();
+  EEPROM.put(1, alarmTimes);
+  EEPROM.put(17, nextAlarm);
+  EEPROM.put(20, nextDay);
   EEPROM.put(24, selectedAlarm);
+  putNetworkToEEPROM();
+  putTimezoneToEEPROM();
+  alarmScheduleChanged = true;
   return EEPROM.commit();
 }
 
@@ -125,29 +216,36 @@ void loadAlarmsFromEEPROM(){
   
       // Alarm theme
       EEPROM.get(24, selectedAlarm);
-      Serial.println("Loaded alarms from EEPROM");
+
+      // Network and timezone, flash that was never written reads 255
+      byte temp;
+      EEPROM.get(29, temp);
+      if(temp == 1){
+        networkOverride = true;
+        EEPROM.get(30, SSID);
+        EEPROM.get(63, PASSWD);
+        SSID[SNAPSHOT_SSID_L - 1] = '\0';
+        PASSWD[SNAPSHOT_PASSWD_L - 1] = '\0';
+      }
+      EEPROM.get(128, temp);
+      if(temp == EEPROMCheckValue){
+        EEPROM.get(129, utcOffsetInSeconds);
+        EEPROM.get(133, considerLegalHour);
+      }
+      EEPROM.get(134, configVersion);
+      if(configVersion == 0xFFFFFFFF){
+        configVersion = 0;
+      }
+      LOG_INFO("Loaded alarms from EEPROM\n");
   
     }else{
-      Serial.println("EEPROM not initialized yet");
+      LOG_WARN("EEPROM not initialized yet\n");
     }
   }else{
-    Serial.println("EEPROM reading failed");
+    LOG_ERROR("EEPROM reading failed\n");
   }
 }
 
-int calculateCenterTextColumnStart(int length) {
-  return (columns - length) / 2;
-}
-
-int calculateCenterTextColumnStart(String text) {
-  return calculateCenterTextColumnStart(text.length());
-}
-
-void centerPrint(String text, int row = 0) {
-  lcd.setCursor(calculateCenterTextColumnStart(text), row);
-  lcd.print(text);
-}
-
 void toggleBacklight() {
   isBacklightOn ? lcd.noBacklight() : lcd.backlight();
   isBacklightOn = !isBacklightOn;
@@ -155,50 +253,59 @@ void toggleBacklight() {
 
 void connectWifi();
 bool setWifiFromWebserver(String, String);
+uint32_t getUTCTime(uint16_t& fraction);
 
+// The station keeps trying to connect while the access point is up, and the clock keeps working
 void connectionFailed(){
   notConnectedMode = true;
 
-  WiFi.mode(WIFI_AP);
+  WiFi.mode(WIFI_AP_STA);
   WiFi.softAP("ESPSveglia", AP_PASSWD);
   lcd.clear();
-  centerPrint("IP: " + WiFi.softAPIP().toString(), 1);
-  centerPrint("Press to set time", 2);
+  IPAddress ip = WiFi.softAPIP();
+  centerPrint(LcdLine("IP: %d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]), 1);
+  if(ntpEpochTime == 0){
+    CENTER_PRINT("Press to set time", 2);
+  }
 }
 
 void connectWifi() {
   if(timeSetManually)
     return;
 
+  StallScope stallScope(STALL_WIFI);
   int retries = 10;
   if(WiFi.status() != WL_CONNECTED){
-    WiFi.mode(WIFI_STA);
+    WiFi.mode(notConnectedMode ? WIFI_AP_STA : WIFI_STA);     // Don't drop the clients of the access point
     WiFi.setHostname("ESPSveglia"); 
     WiFi.begin(SSID, PASSWD);
 
     while (WiFi.status() != WL_CONNECTED && retries-- > 0) {
+      // A due alarm doesn't wait for the retries, the connection goes on in the background
+      if(alarmTimerExpired){
+        return;
+      }
       delay(500);
-      centerPrint("Retries: " + String(retries), 2);
-      Serial.print(".");
+      stallHeartbeat();     // The retries are a wait, not a stall
+      centerPrint(LcdLine("Retries: %d", retries), 2);
+      loopLog();
     }
 
     if(retries == -1){
-      centerPrint("Connection failed!", 1);
+      logEvent(EVENT_WIFI_FAILED);
+      CENTER_PRINT("Connection failed!", 1);
       connectionFailed();
       delay(1000);
+      stallHeartbeat();
       return;
     }else{
       notConnectedMode = false;
+      logEvent(EVENT_WIFI_CONNECTED, WiFi.RSSI());
     }
 
-    if(!MDNS.begin("espsveglia")) {     // Sets the esp mDNS to "espsveglia.local"
-      Serial.println("Error setting up MDNS responder!");
-    }
+    startDiscovery();     // espsveglia.local and the _sveglia._tcp service
 
-    Serial.print("Connected to ");
-    Serial.println(SSID);
-    Serial.print("Ip address: ");
-    Serial.println(WiFi.localIP());
+    LOG_INFO("Connected to %s, IP address %s\n", SSID, WiFi.localIP().toString().c_str());
   }
 }
 
@@ -212,8 +319,7 @@ int lastSundayDay(int mday, int wday){
       return mday - wday;
     }
   }else{
-    printf("Mday: %d\n", mday);
-    printf("7 - wday: %d\naltro: %d\n", 7 - wday, 7 * (int)std::floor(((31 - mday) / 7) - 1));
+    LOG_DEBUG("Last sunday from day %d, %d days to sunday, %d more\n", mday, 7 - wday, 7 * (int)std::floor(((31 - mday) / 7) - 1));
     return mday + (7 - wday) + 7 * (int)std::floor(((31 - mday) / 7) - 1);
   }
 }
@@ -227,35 +333,25 @@ void hourChange(){
 
 void applyLegalHour(){
   hours += 1;
+  legalHourOffset = 3600;
   hourChange();
 }
 
-void updateNTPTime() {
-  if(timeSetManually)
-    return;
-
-  Serial.println("Updating time...");
-  Serial.printf("Was %02d:%02d:%02d", hours, minutes, seconds);
-
-  connectWifi();
-  timeClient.begin();
-  while(!timeClient.update()){
-    delay(50);
-    if(timeClient.forceUpdate()){   // Try to force the update since it only updates every 60 secs
-      break;
-    }
-  } // Retry until the update succeds
-
-  seconds = timeClient.getSeconds();
-  minutes = timeClient.getMinutes();
-  hours = timeClient.getHours();
-  day = timeClient.getDay();
-  ntpEpochTime = timeClient.getEpochTime();
-  ntpStart = millis();
+// Sets the clock from a local epoch (UTC + utcOffsetInSeconds), fraction is in milliseconds
+void setLocalTime(unsigned long epoch, unsigned int fraction = 0){
+  uint64_t previousMillis = wallClockMillis();
+  seconds = epoch % 60;
+  minutes = (epoch / 60) % 60;
+  hours = (epoch / 3600) % 24;
+  day = (epoch / 86400 + 4) % 7;    // 1/1/1970 was a thursday
+  ntpEpochTime = epoch;
+  ntpStart = millis() - fraction;
+  prevSeconds = seconds;
+  legalHourOffset = 0;
 
   if(considerLegalHour){
     // Legal hour >:(
-    time_t current_time = timeClient.getEpochTime();
+    time_t current_time = epoch;
     struct tm* timeInfo = localtime(&current_time);
     int month = timeInfo->tm_mon;
     int mday = timeInfo->tm_mday;
@@ -290,9 +386,98 @@ void updateNTPTime() {
     }
   }
 
-  Serial.printf("Is now %02d:%02d:%02d", hours, minutes, seconds);
+  // A step, like the first sync after the time was entered by hand, searches the next alarm
+  // again instead of handling the alarms it jumped over as late
+  int64_t step = (int64_t)wallClockMillis() - (int64_t)previousMillis;
+  if(previousMillis == 0 || step > ALARM_GRACE_SECONDS * 1000LL || step < -ALARM_GRACE_SECONDS * 1000LL){
+    alarmScheduleChanged = true;
+  }
+  armAlarmTimer();
+}
+
+NtpExchange ntpExchange;
+bool ntpUpdating = false;         // A sync was asked and didn't succeed yet
+bool ntpExchangeRunning = false;  // The samples of an attempt are being taken
+uint16_t ntpRetries = 0;
+unsigned long ntpRetryMillis = 0;
 
-  timeClient.end();
+// Starts a sync, loopNTPUpdate() reads the answers in the next loop cycles
+void updateNTPTime() {
+  if(timeSetManually || notConnectedMode || ntpUpdating)
+    return;
+
+  connectWifi();
+  if(WiFi.status() != WL_CONNECTED){
+    return;
+  }
+  // The lookup waits, it's done here with the WiFi connection, loopNTPUpdate() does it only after a failure
+  if(!ntpResolve(ntpServer, ntpExchange)){
+    LOG_WARN("Can't resolve %s\n", ntpServer);
+  }
+  LOG_DEBUG("Updating time, was %02d:%02d:%02d\n", hours, minutes, seconds);
+  ntpUDP.begin(ntpLocalPort);
+  ntpUpdating = true;
+  ntpExchangeRunning = false;
+  ntpRetries = 0;
+}
+
+void loopNTPUpdate() {
+  if(!ntpUpdating){
+    return;
+  }
+  StallScope stallScope(STALL_NTP);
+
+  // Retry every second until the update succeeds, without stopping the loop
+  int state;
+  if(!ntpExchangeRunning){
+    if(ntpRetries > 0 && millis() - ntpRetryMillis < NTP_RETRY_MILLIS){
+      return;
+    }
+    // After a failure the address is resolved again, but not when an alarm has to ring
+    if(!ntpExchange.server.isSet() && (alarmTimerExpired || !ntpResolve(ntpServer, ntpExchange))){
+      ntpRetries++;
+      ntpRetryMillis = millis();
+      return;
+    }
+    ntpExchangeRunning = ntpBegin(ntpUDP, ntpSamples, ntpExchange);
+    state = ntpExchangeRunning ? NTP_BUSY : NTP_FAILED;
+  }else{
+    state = ntpPoll(ntpUDP, ntpExchange);
+  }
+  if(state == NTP_BUSY){
+    return;
+  }
+  ntpExchangeRunning = false;
+  if(state == NTP_FAILED){
+    ntpRetries++;
+    ntpRetryMillis = millis();
+    return;
+  }
+  ntpUDP.stop();
+  ntpUpdating = false;
+  const NtpSample& sample = ntpExchange.best;
+
+  // Where the clock thought it was, in milliseconds, to log the correction
+  bool wasSynced = ntpEpochTime != 0;
+  unsigned long previousStart = ntpStart;
+  unsigned long previousEpochTime = ntpEpochTime;
+
+  // The answer arrived a few milliseconds ago
+  unsigned long fraction = sample.millis + (millis() - sample.local);
+  setLocalTime(sample.seconds + utcOffsetInSeconds + fraction / 1000, fraction % 1000);
+  syncSource = "ntp";
+  syncServer = sample.server;
+  lastSyncMillis = millis();
+
+  long correction = (long)(ntpEpochTime - previousEpochTime) * 1000 - (long)(ntpStart - previousStart);
+  logEvent(EVENT_NTP_SYNC, wasSynced ? correction : 0, ntpRetries);
+  telemetryAdd(TM_NTP_SYNCS);
+  telemetryAdd(TM_NTP_RETRIES, ntpRetries);
+  if(wasSynced){
+    telemetryObserve(TM_NTP_CORRECTION, correction < 0 ? -correction : correction);
+  }
+
+  LOG_INFO("Time is now %02d:%02d:%02d.%03lu (delay %lu us)\n", hours, minutes, seconds, (millis() - ntpStart) % 1000, sample.delay);
 }
 
 void drawMainScreen();
@@ -306,6 +491,7 @@ void closeMenu(){
 }
 
 void renderMenu(MenuItem* menu, int firstOption, bool resetCursor = true) {
+  glyphs.beginScreen();
   lcd.clear();
   int bound = currentMenuLength > 4 ? (firstOption + 4) : currentMenuLength;
   for (int i = firstOption; i < bound; i++) {
@@ -313,9 +499,13 @@ void renderMenu(MenuItem* menu, int firstOption, bool resetCursor = true) {
     lcd.print(menu[i].getText().c_str());
     if (i == firstOption + 3) {
       lcd.setCursor(columns - 1, i - firstOption);
-      lcd.write(0);
+      lcd.write(glyphs.get(GLYPH_DOWN_ARROW));
     }
   }
+  if(firstOption > 0){
+    lcd.setCursor(columns - 1, 0);
+    lcd.write(glyphs.get(GLYPH_UP_ARROW));
+  }
   if(resetCursor){
     lcd.cursor();
     lcd.setCursor(0, 0);
@@ -338,9 +528,9 @@ int timeEquals(int h1, int min1, int h2, int min2){
   }
 }
 
-int* getNextAlarmTime(){
+// ret = { day, hour, minutes }, day is 255 if there is no alarm
+void getNextAlarmTime(int ret[3]){
   bool set = false;
-  int* ret = (int*)malloc(sizeof(int) * 3);
 
   if(nextDay != -1){
 
@@ -351,13 +541,15 @@ int* getNextAlarmTime(){
   }
 
   if(!set){
+    // The day on the display, with the legal hour, as checkAlarmDeadline() uses
+    int32_t today = wallClockMillis() / 1000 / 86400;
     for(int i = 0; i < 7; i++){
       int alarmHour, alarmMinutes, alarmDay;
 
       alarmDay = (i + day) % 7;
       alarmHour = alarmTimes[alarmDay][0];
       alarmMinutes = alarmTimes[alarmDay][1];
-      if(alarmHour != 255 && (timeEquals(hours, minutes, alarmHour, alarmMinutes) == -1 || alarmDay != day)){
+      if(alarmHour != 255 && !isDaySkipped(today + i) && (timeEquals(hours, minutes, alarmHour, alarmMinutes) == -1 || alarmDay != day)){
         ret[0] = alarmDay;
         ret[1] = alarmHour;
         ret[2] = alarmMinutes;
@@ -370,29 +562,14 @@ int* getNextAlarmTime(){
   if(!set){
     ret[0] = 255;
   }
-  
-  return ret;
 }
 
 void drawMainScreen(){
-  lcd.clear();
-  lcd.noCursor();
-
-  // The length of the time is always 8 chars with seconds
-  lcd.setCursor(calculateCenterTextColumnStart(8), 0);
-  lcd.printf("%02d:%02d:%02d", hours, minutes, seconds);
-
-
-  int* nextAlarm = getNextAlarmTime();
-  if(nextAlarm[0] != 255){
-    centerPrint("Next alarm:", 2);
-  
-    char buffer[columns + 1];
-    const char* dismissed = dismissNextAlarm ? "[D]" : "";
-    sprintf(buffer, "%02d:%02d %s %s", nextAlarm[1], nextAlarm[2], daysOfTheWeek[nextAlarm[0]], dismissed);
-    centerPrint(buffer, 3);
-  }
-  free(nextAlarm);
+  int nextAlarm[3];
+  getNextAlarmTime(nextAlarm);
+  IPAddress ip = WiFi.softAPIP();
+  uint8_t apAddress[4] = { ip[0], ip[1], ip[2], ip[3] };
+  drawClockScreen(hours, minutes, seconds, WiFi.status() == WL_CONNECTED, nextAlarm, dismissNextAlarm, notConnectedMode ? apAddress : nullptr);
 }
 
 void changeMenu(MenuItem* menu, int length){
@@ -407,7 +584,6 @@ void changeMenu(MenuItem* menu, int length){
 
 
 void minuteChange(){
-  alarmSounded = false;
   if (minutes == 60) {
     minutes = 0;
     hours += 1;
@@ -417,14 +593,14 @@ void minuteChange(){
 
 IRAM_ATTR void encoderRotateInterrupt() {
   if(genericCount){
-    if(!genericDelay){    // This is because you can't do delays in functions nested too deep :(
-      if(digitalRead(DT)){
-        genericCouter--;
-      }else{
-        genericCouter++;
-      }
-      genericDelay = true;
+    // Bounces of the contacts come within a few milliseconds, when the queue is full the step is lost
+    uint8_t next = (encoderHead + 1) % ENCODER_QUEUE;
+    if(millis() - encoderLastEdge >= ENCODER_DEBOUNCE && next != encoderTail){
+      encoderQueue[encoderHead].time = millis();
+      encoderQueue[encoderHead].direction = digitalRead(DT) ? -1 : 1;
+      encoderHead = next;
     }
+    encoderLastEdge = millis();
   }else if(isMenuOpen){
     // Change the current menu option
     if(digitalRead(DT)){
@@ -452,69 +628,100 @@ int abs(int x){
   return x > 0 ? x : -x;
 }
 
-void playAlarm(){
+#define DEFAULT_SNOOZE_MINUTES 9
+
+// Set by the dismiss and snooze commands while the alarm rings
+bool alarmRinging = false;
+bool remoteDismiss = false;
+unsigned int snoozeMinutes = 0;
+
+// The console and MQTT keep running while the alarm rings, they can dismiss it
+bool alarmKeepRinging(){
+  consoleLoop();
+  loopMqtt(false);
+  loopLog();
+  return digitalRead(SW) && !remoteDismiss;
+}
+
+// Returns how many milliseconds it took to dismiss the alarm
+unsigned long playAlarm(){
   MenuItem* prev;
   int length;
   if(isMenuOpen){
     prev = currentMenu;
     length = currentMenuLength;
   }
-  alarmSounded = true;
-
   isBacklightOn = true;
   backlightTimer = millis();
   lcd.backlight();
   lcd.clear();
-  centerPrint("WAKE UP!", 1);
-
+  CENTER_PRINT("WAKE UP!", 1);
+
+  StallScope stallScope(STALL_ALARM);
+  unsigned long start = millis();
+  alarmRinging = true;
+  remoteDismiss = false;
+  snoozeMinutes = 0;
+  mqttSetState(MQTT_ALARM, "ringing");
+  startAlarmSound();
   do{
-    alarmArray[selectedAlarm]();
-  }while(digitalRead(SW));
+    playMelody(*alarmMelodies[selectedAlarm], alarmKeepRinging);
+  }while(alarmKeepRinging());
+  stopAlarmSound();
+  alarmRinging = false;
+  mqttSetState(MQTT_ALARM, "idle");
+  unsigned long latency = millis() - start;
 
   if(isMenuOpen){
     changeMenu(prev, length);
   }
+  return latency;
 }
 
-int* selectAlarmTime(String header = ""){
+// Moves the value with the encoder steps queued since the last call
+int readEncoderValue(EncoderAccelerator& accelerator, int value, int range){
+  while(encoderTail != encoderHead){
+    volatile EncoderEvent& event = encoderQueue[encoderTail];
+    value = applyEncoderStep(value, accelerator.step(event.time, event.direction), range);
+    encoderTail = (encoderTail + 1) % ENCODER_QUEUE;
+  }
+  return value;
+}
+
+int* selectAlarmTime(const __FlashStringHelper* header = nullptr){
   int* ret = (int*)malloc(sizeof(int) * 2);
+  encoderTail = encoderHead;
   genericCount = true;
-  genericCouter = 0;
   lcd.clear();
   lcd.noCursor();
-  if(header != ""){
+  if(header){
     centerPrint(header);
   }else{
-    centerPrint("Alarm time");
+    CENTER_PRINT("Alarm time", 0);
   }
   delay(200);
 
   int min = 0, h = 0;
-  char buffer[5]; // "0" "0" ":" "0" "0" "\0"
   // Hour
+  EncoderAccelerator hourAccelerator(hourProfile);
   do{
-    if(genericCouter < 0){
-      genericCouter = 23;
-    }
-    h = genericCouter % 24;
-    sprintf(buffer, "%02d:%02d", h, min);
-    centerPrint(buffer, 1);
+    h = readEncoderValue(hourAccelerator, h, 24);
+    centerPrint(FixedString<5>("%02d:%02d", h, min), 1);
     delay(50);
-    genericDelay = false;
+    stallHeartbeat();
+    loopLog();
   }while(digitalRead(SW));
-  genericCouter = 0;
   delay(100);
-  
+  encoderTail = encoderHead;
+
   // Minutes
+  EncoderAccelerator minuteAccelerator(minuteProfile);
   do{
-    if(genericCouter < 0){
-      genericCouter = 59;
-    }
-    min = genericCouter % 60;
-    sprintf(buffer, "%02d:%02d", h, min);
-    centerPrint(buffer, 1);
+    min = readEncoderValue(minuteAccelerator, min, 60);
+    centerPrint(FixedString<5>("%02d:%02d", h, min), 1);
     delay(50);
-    genericDelay = false;
+    stallHeartbeat();
+    loopLog();
   }while(digitalRead(SW));
 
   genericCount = false;
@@ -532,11 +739,8 @@ void changeToMainMenu();
 //  --- CALLBACKS ---
 //
 
+// The time on the main screen changes as soon as the answers arrive
 void updateTimeCallback(){
-  lcd.clear();
-  lcd.noCursor();
-  centerPrint("Updating time...", 1);
-
   updateNTPTime();
   closeMenu();
 }
@@ -565,6 +769,7 @@ MenuItem alarmSelectMenu[alarmSelectMenuLength] = { MenuItem("Back", changeToMai
 void confirmAlarmCallback(){
   if(menuOption == 0){
     selectedAlarm = tempAlarm;
+    alarmConfigChanged();
     saveAlarmThemeToEEPROM();
   }
   changeMenu(alarmSelectMenu, alarmSelectMenuLength);
@@ -626,13 +831,14 @@ void setupAlarmDayCallback(){
       alarmTimes[(selectedDay - 2 + 1) % 7][1] = min;
       break;
     default:
-      Serial.println("How did we even get to this index??");
+      LOG_ERROR("How did we even get to this index??\n");
       exit(999);
       break;
   }
 
+  alarmConfigChanged();
   saveAlarmsToEEPROM();
-  Serial.println("Saved alarms to flash!");
+  LOG_INFO("Saved alarms to flash!\n");
 
   changeMenu(alarmMenu, 10);
 }
@@ -676,7 +882,7 @@ void mainTestAlarmCallback(){
 void setupWifiCallback(){
   isMenuOpen = false;
   timeSetManually = false;
-  lcd.cursor_off();
+  lcd.noCursor();
   WiFi.disconnect();
   connectionFailed();
 }
@@ -722,17 +928,18 @@ void removeAlarmDayCallback(){
       alarmTimes[(selectedDay - 2 + 1) % 7][1] = 255;
       break;
     default:
-      Serial.println("How did we even get to this index??");
+      LOG_ERROR("How did we even get to this index??\n");
       exit(999);
       break;
   }
 
+  alarmConfigChanged();
   saveAlarmsToEEPROM();
-  Serial.println("Saved alarms to flash!");
+  LOG_INFO("Saved alarms to flash!\n");
 
   lcd.clear();
   lcd.noCursor();
-  centerPrint("Alarm removed", 1);
+  CENTER_PRINT("Alarm removed", 1);
   delay(1000);
 
   changeMenu(alarmMenu, 10);
@@ -747,7 +954,7 @@ void removeNextAlarmCallback(){
 
   lcd.clear();
   lcd.noCursor();
-  centerPrint("Next alarm removed", 1);
+  CENTER_PRINT("Next alarm removed", 1);
   delay(1000);
 
   changeToMainMenu();
@@ -762,9 +969,9 @@ void dismissCallback(){
   lcd.clear();
   lcd.noCursor();
   if(dismissNextAlarm){
-    centerPrint("Next alarm dismissed", 1);
+    CENTER_PRINT("Next alarm dismissed", 1);
   }else{
-    centerPrint("Next alarm resumed", 1);
+    CENTER_PRINT("Next alarm resumed", 1);
   }
   delay(1500);
 
@@ -772,41 +979,431 @@ void dismissCallback(){
 }
 
 boolean setWifiFromWebserver(String ssid, String passwd){
-  SSID = ssid.c_str();
-  PASSWD = passwd.c_str();
+  if(ssid.length() >= SNAPSHOT_SSID_L || passwd.length() >= SNAPSHOT_PASSWD_L){
+    return false;
+  }
+  strcpy(SSID, ssid.c_str());
+  strcpy(PASSWD, passwd.c_str());
 
   if(!isBacklightOn){
     toggleBacklight();
   }
   lcd.clear();
-  centerPrint("Connecting to:");
+  CENTER_PRINT("Connecting to:", 0);
   centerPrint(SSID, 1);
 
   WiFi.disconnect();
 
   connectWifi();
   if(WiFi.status() == WL_CONNECTED){
+    networkOverride = true;
+    saveNetworkToEEPROM();
     return true;
   }else{
     return false;
   }
 }
 
-// Custom chars
-byte downArrow[] = {
-  B00000,
-  B00000,
-  B00000,
-  B00000,
-  B00000,
-  B11111,
-  B01110,
-  B00100
-};
+SettingsSnapshot getSettingsSnapshot(){
+  SettingsSnapshot snapshot;
+  memset(&snapshot, 0, sizeof(snapshot));
+  memcpy(snapshot.alarmTimes, alarmTimes, sizeof(alarmTimes));
+  snapshot.nextAlarm[0] = nextAlarm[0];
+  snapshot.nextAlarm[1] = nextAlarm[1];
+  snapshot.nextDay = nextDay;
+  snapshot.selectedAlarm = selectedAlarm;
+  snapshot.utcOffset = utcOffsetInSeconds;
+  snapshot.considerLegalHour = considerLegalHour;
+  snapshot.hasNetwork = networkOverride;
+  if(networkOverride){
+    strcpy(snapshot.ssid, SSID);
+    strcpy(snapshot.passwd, PASSWD);
+  }
+  return snapshot;
+}
+
+size_t exportSettings(uint8_t* buffer, size_t size){
+  return serializeSnapshot(getSettingsSnapshot(), buffer, size);
+}
+
+// Nothing is changed unless the whole snapshot is valid
+bool importSettings(const uint8_t* buffer, size_t length){
+  SettingsSnapshot snapshot;
+  if(!deserializeSnapshot(buffer, length, snapshot)){
+    return false;
+  }
+  if(!validSnapshotSettings(snapshot, ALARM_MELODIES)){
+    return false;
+  }
+
+  memcpy(alarmTimes, snapshot.alarmTimes, sizeof(alarmTimes));
+  nextAlarm[0] = snapshot.nextAlarm[0];
+  nextAlarm[1] = snapshot.nextAlarm[1];
+  nextDay = snapshot.nextDay;
+  selectedAlarm = snapshot.selectedAlarm;
+
+  // The clock moves to the new time zone now, not at the next sync
+  uint16_t fraction;
+  uint32_t utc = getUTCTime(fraction);
+  utcOffsetInSeconds = snapshot.utcOffset;
+  considerLegalHour = snapshot.considerLegalHour;
+  if(utc != 0){
+    setLocalTime(utc + utcOffsetInSeconds, fraction);
+  }
+
+  // Without a network the credentials of secrets.h are used again
+  networkOverride = snapshot.hasNetwork;
+  strcpy(SSID, snapshot.hasNetwork ? snapshot.ssid : SECRET_SSID);
+  strcpy(PASSWD, snapshot.hasNetwork ? snapshot.passwd : SECRET_PASSWD);
+
+  LOG_INFO("Imported settings snapshot\n");
+  logEvent(EVENT_CONFIG_CHANGED, CONFIG_SNAPSHOT);
+  alarmConfigChanged();
+  return saveAllToEEPROM();
+}
+
+// UTC time, 0 if this clock doesn't know the date
+uint32_t getUTCTime(uint16_t& fraction){
+  if(ntpEpochTime == 0 || timeSetManually){
+    return 0;
+  }
+  // A single sample, so the seconds and the fraction are of the same instant
+  unsigned long elapsed = millis() - ntpStart;
+  fraction = elapsed % 1000;
+  return ntpEpochTime + elapsed / 1000 - utcOffsetInSeconds;
+}
+
+bool getSntpClock(SntpClock& clock){
+  clock.seconds = getUTCTime(clock.millis);
+  clock.referenceSeconds = ntpEpochTime - utcOffsetInSeconds;
+  clock.referenceAddress = syncServer;
+  clock.stratum = fleetIsFollower() ? 4 : 3;   // The pool servers are usually stratum 2
+  return clock.seconds != 0;
+}
+
+// The time sent by the browser is in UTC milliseconds, rtt is the round trip time it measured
+bool setTimeFromBrowser(uint64_t epochMillis, unsigned long rtt){
+  if(epochMillis < 1577836800000ULL){   // Before 2020, the browser clock is wrong
+    return false;
+  }
+  uint64_t now = epochMillis + rtt / 2;
+  setLocalTime(now / 1000 + utcOffsetInSeconds, now % 1000);
+  timeSetManually = false;
+  syncSource = "browser";
+  syncServer = 0;
+  lastSyncMillis = millis();
+  logEvent(EVENT_TIME_SET, rtt);
+  LOG_INFO("Time set from the browser: %02d:%02d:%02d\n", hours, minutes, seconds);
+  return true;
+}
+
+// The page sends the time of the browser every time it's opened, it's taken without asking
+// only if the clock has no recent time from NTP or the fleet, or can't reach them in AP mode
+bool timeFreshlySynced(){
+  bool fromNetwork = strcmp(syncSource, "ntp") == 0 || strcmp(syncSource, "fleet") == 0;
+  return fromNetwork && !notConnectedMode && millis() - lastSyncMillis <= SYNC_STALE_MILLIS;
+}
+
+void setFleetTime(uint32_t epoch, uint16_t fraction){
+  setLocalTime(epoch + utcOffsetInSeconds, fraction);
+  syncSource = "fleet";
+  syncServer = fleetLeaderAddress;
+  lastSyncMillis = millis();
+}
+
+void getFleetConfig(FleetConfig& config){
+  config.version = configVersion;
+  memcpy(config.alarmTimes, alarmTimes, sizeof(alarmTimes));
+  config.selectedAlarm = selectedAlarm;
+}
+
+void applyFleetConfig(const FleetConfig& config){
+  memcpy(alarmTimes, config.alarmTimes, sizeof(alarmTimes));
+  if(config.selectedAlarm < ALARM_MELODIES){
+    selectedAlarm = config.selectedAlarm;
+  }
+  configVersion = config.version;
+  EEPROM.put(134, configVersion);
+  EEPROM.put(24, selectedAlarm);
+  saveAlarmsToEEPROM();
+  LOG_INFO("Fleet: applied config version %u\n", configVersion);
+}
+
+// 
+//  --- SERIAL CONSOLE ---
+//
+
+// millis() of the next second boundary of the clock, and how late the last tick was drawn
+unsigned long nextTick = 0;
+unsigned long tickLateness = 0;
+
+bool batchAlarmsChanged = false;
+bool batchNetworkChanged = false;
+
+// Returns the day of the week, 7 for weekdays, 8 for weekend, 9 for all, -1 if not valid
+int parseConsoleDay(const char* text){
+  for(int i = 0; i < 7; i++){
+    if(strcasecmp_P(text, daysOfTheWeek[i]) == 0){
+      return i;
+    }
+  }
+  if(strcmp(text, "weekdays") == 0) return 7;
+  if(strcmp(text, "weekend") == 0) return 8;
+  if(strcmp(text, "all") == 0) return 9;
+  return -1;
+}
+
+// "HH:MM" or "off" (255)
+bool parseConsoleTime(const char* text, byte time[2]){
+  int h, min;
+  if(strcmp(text, "off") == 0){
+    time[0] = time[1] = 255;
+    return true;
+  }
+  if(sscanf(text, "%d:%d", &h, &min) != 2 || h < 0 || h > 23 || min < 0 || min > 59){
+    return false;
+  }
+  time[0] = h;
+  time[1] = min;
+  return true;
+}
+
+void printConsoleAlarm(const char* name, const byte time[2]){
+  if(time[0] == 255){
+    consoleOutput->printf("%s off\n", name);
+  }else{
+    consoleOutput->printf("%s %02d:%02d\n", name, time[0], time[1]);
+  }
+}
+
+// Outside of a batch every change is saved at once, in a batch "commit" saves them together
+bool consoleAlarmsChanged(bool sound = false){
+  alarmScheduleChanged = true;
+  if(consoleBatch){
+    batchAlarmsChanged = true;
+    return true;
+  }
+  alarmConfigChanged();
+  return sound ? saveAlarmThemeToEEPROM() : saveAlarmsToEEPROM();
+}
+
+bool consoleCommit(){
+  if(batchAlarmsChanged){
+    alarmConfigChanged();
+  }
+  bool saved = saveAllToEEPROM();
+  if(batchNetworkChanged){
+    WiFi.disconnect();
+    WiFi.begin(SSID, PASSWD);
+  }
+  batchAlarmsChanged = false;
+  batchNetworkChanged = false;
+  return saved;
+}
+
+void printConsoleMetrics(){
+  uint16_t fraction;
+  consoleOutput->printf("uptime_s %lu\n", millis() / 1000);
+  consoleOutput->printf("free_heap %u\n", ESP.getFreeHeap());
+  consoleOutput->printf("heap_fragmentation %u\n", ESP.getHeapFragmentation());
+  consoleOutput->printf("wifi_connected %d\n", WiFi.status() == WL_CONNECTED);
+  consoleOutput->printf("rssi %d\n", WiFi.RSSI());
+  consoleOutput->printf("utc_time %u\n", getUTCTime(fraction));
+  consoleOutput->printf("tick_lateness_ms %lu\n", tickLateness);
+  consoleOutput->printf("lcd_bytes %lu\n", lcd.getBytesSent());
+  consoleOutput->printf("lcd_transmissions %lu\n", lcd.getTransmissions());
+  consoleOutput->printf("glyph_uploads %lu\n", glyphs.getTotalUploads());
+  consoleOutput->printf("sntp_requests %lu\n", sntpRequests);
+  consoleOutput->printf("sntp_dropped %lu\n", sntpDropped);
+  consoleOutput->printf("audio_underruns %lu\n", audioUnderruns);
+  consoleOutput->printf("log_dropped %u\n", logDropped);
+  consoleOutput->printf("events_logged %u\n", eventNextSequence);
+  consoleOutput->printf("alarms_missed %u\n", alarmsMissed);
+  for(int i = 0; i < LATENESS_BUCKETS; i++){
+    if(alarmLateness[i] > 0 && i == LATENESS_BUCKETS - 1){
+      consoleOutput->printf("alarm_lateness_lt_inf_ms %u\n", alarmLateness[i]);
+    }else if(alarmLateness[i] > 0){
+      consoleOutput->printf("alarm_lateness_lt_%lu_ms %u\n", 1UL << i, alarmLateness[i]);
+    }
+  }
+}
+
+void setupConsoleCommands(){
+  consoleCommand("alarms", "", [](int, char**){
+    char dayName[10];
+    for(int i = 0; i < 7; i++){
+      strcpy_P(dayName, daysOfTheWeek[i]);
+      printConsoleAlarm(dayName, alarmTimes[i]);
+    }
+    if(nextDay != -1){
+      strcpy_P(dayName, daysOfTheWeek[nextDay]);
+      consoleOutput->printf("next %s ", dayName);
+      printConsoleAlarm("at", nextAlarm);
+    }
+    consoleOutput->printf("skip %d\n", dismissNextAlarm);
+    return true;
+  });
+
+  consoleCommand("alarm", "<day|weekdays|weekend|all> <HH:MM|off>", [](int argc, char** argv){
+    byte time[2];
+    int selected = argc == 2 ? parseConsoleDay(argv[0]) : -1;
+    if(selected < 0 || !parseConsoleTime(argv[1], time)){
+      return false;
+    }
+    for(int i = 0; i < 7; i++){
+      bool weekend = i == 0 || i == 6;
+      if(selected == i || selected == 9 || (selected == 7 && !weekend) || (selected == 8 && weekend)){
+        alarmTimes[i][0] = time[0];
+        alarmTimes[i][1] = time[1];
+      }
+    }
+    return consoleAlarmsChanged();
+  });
+
+  consoleCommand("next", "<day|today|tomorrow> <HH:MM> | off", [](int argc, char** argv){
+    if(argc == 1 && strcmp(argv[0], "off") == 0){
+      nextDay = -1;
+      nextAlarm[0] = nextAlarm[1] = 255;
+      return consoleAlarmsChanged();
+    }
+    if(argc != 2){
+      return false;
+    }
+    int selected = strcmp(argv[0], "today") == 0 ? day : (strcmp(argv[0], "tomorrow") == 0 ? (day + 1) % 7 : parseConsoleDay(argv[0]));
+    byte time[2];
+    if(selected < 0 || selected > 6 || !parseConsoleTime(argv[1], time) || time[0] == 255){
+      return false;
+    }
+    memcpy(nextAlarm, time, sizeof(nextAlarm));
+    nextDay = selected;
+    return consoleAlarmsChanged();
+  });
+
+  consoleCommand("skip", "[0|1]", [](int argc, char** argv){
+    if(argc == 1){
+      dismissNextAlarm = strcmp(argv[0], "1") == 0;
+    }
+    consoleOutput->printf("skip %d\n", dismissNextAlarm);
+    return true;
+  });
+
+  consoleCommand("dismiss", "", [](int, char**){
+    if(!alarmRinging){
+      return false;
+    }
+    remoteDismiss = true;
+    return true;
+  });
+
+  consoleCommand("snooze", "[minutes]", [](int argc, char** argv){
+    int length = argc == 1 ? atoi(argv[0]) : DEFAULT_SNOOZE_MINUTES;
+    if(!alarmRinging || length <= 0 || length > 120){
+      return false;
+    }
+    snoozeMinutes = length;
+    remoteDismiss = true;
+    return true;
+  });
+
+  consoleCommand("sound", "[0-5]", [](int argc, char** argv){
+    if(argc == 1){
+      unsigned int sound = atoi(argv[0]);
+      if(sound >= ALARM_MELODIES){
+        return false;
+      }
+      selectedAlarm = sound;
+      if(!consoleAlarmsChanged(true)){
+        return false;
+      }
+    }
+    consoleOutput->printf("sound %d\n", selectedAlarm);
+    return true;
+  });
+
+  consoleCommand("time", "[<UTC epoch> [milliseconds]]", [](int argc, char** argv){
+    if(argc >= 1){
+      uint64_t epochMillis = (uint64_t)strtoul(argv[0], nullptr, 10) * 1000 + (argc >= 2 ? atoi(argv[1]) % 1000 : 0);
+      if(!setTimeFromBrowser(epochMillis, 0)){
+        return false;
+      }
+    }
+    char dayName[10];
+    strcpy_P(dayName, daysOfTheWeek[day]);
+    consoleOutput->printf("time %02d:%02d:%02d %s\n", hours, minutes, seconds, dayName);
+    return true;
+  });
+
+  consoleCommand("timezone", "[<UTC offset in seconds> <legal hour 0|1>]", [](int argc, char** argv){
+    if(argc == 2){
+      uint16_t fraction;
+      uint32_t utc = getUTCTime(fraction);
+      utcOffsetInSeconds = atol(argv[0]);
+      considerLegalHour = strcmp(argv[1], "1") == 0;
+      if(utc != 0){
+        setLocalTime(utc + utcOffsetInSeconds, fraction);
+      }
+      if(!consoleBatch){
+        putTimezoneToEEPROM();
+        if(!EEPROM.commit()){
+          return false;
+        }
+      }
+    }else if(argc != 0){
+      return false;
+    }
+    consoleOutput->printf("timezone %ld %d\n", utcOffsetInSeconds, considerLegalHour);
+    return true;
+  });
+
+  consoleCommand("wifi", "[<ssid> <password>]", [](int argc, char** argv){
+    if(argc == 2){
+      if(strlen(argv[0]) >= SNAPSHOT_SSID_L || strlen(argv[1]) >= SNAPSHOT_PASSWD_L){
+        return false;
+      }
+      strcpy(SSID, argv[0]);
+      strcpy(PASSWD, argv[1]);
+      networkOverride = true;
+      // The connection goes on in the background
+      if(consoleBatch){
+        batchNetworkChanged = true;
+      }else{
+        if(!saveNetworkToEEPROM()){
+          return false;
+        }
+        WiFi.disconnect();
+        WiFi.begin(SSID, PASSWD);
+      }
+    }else if(argc != 0){
+      return false;
+    }
+    consoleOutput->printf("wifi \"%s\" %s %s\n", SSID, WiFi.status() == WL_CONNECTED ? "connected" : "disconnected", WiFi.localIP().toString().c_str());
+    return true;
+  });
+
+  consoleCommand("metrics", "", [](int, char**){
+    printConsoleMetrics();
+    return true;
+  });
+
+  setupConsole(consoleCommit);
+}
+
+WiFiEventHandler wifiDisconnectedHandler;
 
 void setup() {
   Serial.begin(115200);  // Start serial communication at 115200 baud
-  EEPROM.begin(64);
+  EEPROM.begin(EEPROMSize);
+
+  setupEventLog(currentEpochTime);
+  logEvent(EVENT_RESET, ESP.getResetInfoPtr()->reason);
+  setupStallDetector([](const StallRecord& record) {
+    logEvent(EVENT_STALL, record.pc, record.section);
+    telemetryAdd(TM_STALLS);
+  });
+  wifiDisconnectedHandler = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected& event) {
+    logEvent(EVENT_WIFI_DISCONNECTED, event.reason);
+    telemetryAdd(TM_WIFI_DISCONNECTS);
+  });
 
   pinMode(buzzerPin, OUTPUT);
   pinMode(CLK, INPUT);
@@ -818,38 +1415,50 @@ void setup() {
   digitalWrite(DT, HIGH);
 
   lcd.init();
-  lcd.createChar(0, downArrow);
+#ifdef LCD_BENCHMARK
+  benchmarkLCD(lcd, columns, rows);
+#endif
   toggleBacklight();
-  centerPrint("Connecting...", 1);
-  Serial.print("\n\nStarting...");
+  CENTER_PRINT("Connecting...", 1);
+  LOG_INFO("\n\nStarting...\n");
 
   loadAlarmsFromEEPROM();
 
   for(int i = 0; i < 7; i++){
-    Serial.printf("%d: %s -> hour: %d minute: %d\n", i, daysOfTheWeek[i], alarmTimes[i][0], alarmTimes[i][1]);
+    char dayName[sizeof(daysOfTheWeek[0])];
+    strcpy_P(dayName, daysOfTheWeek[i]);
+    LOG_DEBUG("%d: %s -> hour: %d minute: %d\n", i, dayName, alarmTimes[i][0], alarmTimes[i][1]);
   }
-  Serial.printf("Next alarm -> h: %d min: %d\nNext day %d\n", nextAlarm[0], nextAlarm[1], nextDay);
+  LOG_DEBUG("Next alarm -> h: %d min: %d\nNext day %d\n", nextAlarm[0], nextAlarm[1], nextDay);
 
   // Arduino OTA
   ArduinoOTA.onStart([] () {
-    Serial.println("Started OTA");
+    LOG_INFO("Started OTA\n");
   });
 
   ArduinoOTA.onEnd([]() {
-    Serial.println("OTA end");
+    LOG_INFO("OTA end\n");
+    logFlush();     // ArduinoOTA restarts right after
   });
 
+  // Every 10%, a message per chunk would fill the log buffer
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    Serial.printf("OTA update progress: %u%%\r", (progress / (total / 100)));
+    static unsigned int lastStep = 0;
+    unsigned int step = progress / (total / 10 + 1);
+    if(step != lastStep){
+      lastStep = step;
+      LOG_DEBUG("OTA update progress: %u%%\n", step * 10);
+    }
   });
 
   ArduinoOTA.onError([](ota_error_t error) {
-    Serial.printf("Error[%u]: ", error);
-    if (error == OTA_AUTH_ERROR) Serial.println("Auth Failed");
-    else if (error == OTA_BEGIN_ERROR) Serial.println("Begin Failed");
-    else if (error == OTA_CONNECT_ERROR) Serial.println("Connect Failed");
-    else if (error == OTA_RECEIVE_ERROR) Serial.println("Receive Failed");
-    else if (error == OTA_END_ERROR) Serial.println("End Failed");
+    const char* name = "Unknown";
+    if (error == OTA_AUTH_ERROR) name = "Auth";
+    else if (error == OTA_BEGIN_ERROR) name = "Begin";
+    else if (error == OTA_CONNECT_ERROR) name = "Connect";
+    else if (error == OTA_RECEIVE_ERROR) name = "Receive";
+    else if (error == OTA_END_ERROR) name = "End";
+    LOG_ERROR("OTA error[%u]: %s Failed\n", error, name);
   });
 
   ArduinoOTA.begin();
@@ -858,51 +1467,149 @@ void setup() {
   // Encoder
   attachInterrupt(digitalPinToInterrupt(14), encoderRotateInterrupt, FALLING);
 
-  setupServer(connectWifi, setWifiFromWebserver);
+  setupServer(connectWifi, setWifiFromWebserver, exportSettings, importSettings);
+  setupOtaServer();
+  setupSetTimeServer(setTimeFromBrowser, timeFreshlySynced);
+  setupSntpServer(getSntpClock);
+  setupHolidays(currentEpochTime);
+  setupAlarmDeadlines(wallClockMillis);
+  setupConsoleCommands();
+  setupMqtt(runConsoleLine);
+  setupTelemetry();
+  setupFleetSync(configVersion, getUTCTime, setFleetTime, getFleetConfig, applyFleetConfig);
   connectWifi();
 }
 
 const int NTPUpdateMillisDelay = 1000 * 60 * 5;  // Update every 5 minutes
 
-long long int prev = 0;
 long long int lastTimeUpdate = -NTPUpdateMillisDelay; // It updates on the first loop cycle
-byte prevSeconds = -1;
 
-void normalLoop(){
+// The time in the event is UTC, it may be sent much later
+void publishAlarmEvent(const char* event, long value = 0){
+  uint16_t fraction;
+  char payload[64];
+  snprintf(payload, sizeof(payload), "{\"event\":\"%s\",\"value\":%ld,\"time\":%u}", event, value, getUTCTime(fraction));
+  mqttPublish(MQTT_EVENT, payload);
+}
+
+void checkAlarmDeadline(){
+  uint64_t now = wallClockMillis();
+  if(now == 0){
+    return;
+  }
+  if(alarmScheduleChanged){
+    bool temporary;
+    uint32_t deadline = nextAlarmTime(now / 1000, alarmTimes, nextAlarm, nextDay, temporary);
+    scheduleAlarm(deadline, temporary);
+  }
+
+  int64_t lateness = alarmDeadlineLateness();
+  if(lateness < 0){
+    return;
+  }
+
   // It's time
-  if((alarmTimes[day][0] == hours && alarmTimes[day][1] == minutes && nextDay != day) || (nextAlarm[0] == hours && nextAlarm[1] == minutes && nextDay == day)){
-    if(dismissNextAlarm){
-      alarmSounded = true;
-      dismissNextAlarm = false;
-    }
-    if(!alarmSounded){
-      playAlarm();
-    }
-    if(nextAlarm[0] != 255 || nextAlarm[1] != 255 || nextDay != -1){
-      nextAlarm[0] = 255;
-      nextAlarm[1] = 255;
-      nextDay = -1;
-      saveAlarmsToEEPROM();
-    }
+  uint32_t deadline = alarmDeadline;
+  bool temporary = alarmDeadlineTemporary;
+  bool snooze = alarmDeadlineSnooze;    // Rings even on holidays and when the next alarm is skipped
+  bool missed = lateness > ALARM_GRACE_SECONDS * 1000LL;
+  unsigned int snoozed = 0;
+  if(missed){
+    alarmsMissed++;
+    logEvent(EVENT_ALARM_MISSED, lateness / 1000);
+    telemetryAdd(TM_ALARMS_MISSED);
+    publishAlarmEvent("missed", lateness / 1000);
+  }else if(!temporary && !snooze && isDaySkipped(deadline / 86400)){
+    logEvent(EVENT_ALARM_SKIPPED, 1);
+    telemetryAdd(TM_ALARMS_SKIPPED);
+    publishAlarmEvent("skipped", 1);
+  }else if(dismissNextAlarm && !snooze){
+    dismissNextAlarm = false;
+    logEvent(EVENT_ALARM_SKIPPED);
+    telemetryAdd(TM_ALARMS_SKIPPED);
+    publishAlarmEvent("skipped");
   }else{
-    alarmSounded = false;
+    recordAlarmLateness(lateness);
+    telemetryObserve(TM_ALARM_LATENESS, lateness);
+    logEvent(EVENT_ALARM_FIRED, selectedAlarm);
+    telemetryAdd(TM_ALARMS_FIRED);
+    publishAlarmEvent("fired", selectedAlarm);
+    unsigned long latency = playAlarm();
+    snoozed = snoozeMinutes;
+    logEvent(EVENT_ALARM_DISMISSED, latency);
+    telemetryObserve(TM_ALARM_LATENCY, latency / 1000);
+    publishAlarmEvent(snoozed ? "snoozed" : "dismissed", latency);
+  }
+  if(temporary){
+    nextAlarm[0] = 255;
+    nextAlarm[1] = 255;
+    nextDay = -1;
+    saveAlarmsToEEPROM();
   }
 
+  if(snoozed){
+    snoozeAlarm(wallClockMillis() / 1000 + snoozed * 60);
+    return;
+  }
+
+  // From the deadline just handled, not from now, so the alarms after it that are still in the
+  // grace window ring too. After a jump of the clock the ones before the window are skipped together.
+  bool nextTemporary;
+  uint32_t after = missed ? now / 1000 - ALARM_GRACE_SECONDS : deadline;
+  uint32_t nextDeadline = nextAlarmTime(after, alarmTimes, nextAlarm, nextDay, nextTemporary);
+  scheduleAlarm(nextDeadline, nextTemporary);
+}
+
+// The state on the retained MQTT topics and in the DNS-SD TXT record, both are sent only when a value changes
+void updatePublishedState(){
+  if(!alarmRinging){
+    mqttSetState(MQTT_ALARM, alarmDeadlineSnooze ? "snoozed" : "idle");
+  }
+
+  char value[32] = "none";
+  if(alarmDeadline != 0){
+    time_t deadline = alarmDeadline;
+    strftime(value, sizeof(value), "%Y-%m-%d %H:%M", gmtime(&deadline));
+    if(dismissNextAlarm && !alarmDeadlineSnooze){
+      strcat(value, " skip");
+    }
+  }
+  mqttSetState(MQTT_NEXT_ALARM, value);
+
+  const char* sync = syncSource;
+  if(ntpEpochTime == 0){
+    sync = "none";
+  }else if(timeSetManually){
+    sync = "manual";
+  }else if(millis() - lastSyncMillis > SYNC_STALE_MILLIS){
+    sync = "stale";
+  }
+  mqttSetState(MQTT_SYNC, sync);
+  setDiscoveryState(value, sync, configVersion);
+}
+
+void normalLoop(){
+  checkAlarmDeadline();
+
   if(!isMenuOpen){
     // Turn off backlight after 10 seconds
     if (isBacklightOn && millis() - backlightTimer > 10000) {
       toggleBacklight();
     }
     // Time logic
-    if (millis() - lastTimeUpdate > NTPUpdateMillisDelay) {
+    // Followers of the fleet get the time from the leader
+    if (millis() - lastTimeUpdate > NTPUpdateMillisDelay && !fleetIsFollower()) {
       updateNTPTime();
       lastTimeUpdate = millis();
     }
   }else{
     backlightTimer = millis();
   }
-  if (millis() - prev > 1000) {
+  if ((long)(millis() - nextTick) >= 0) {
     // One second has passed!
+    // The ticks are aligned to the second boundaries of the synced time, not to when the loop got here
+    nextTick = nextSecondTick(millis(), ntpStart, tickLateness);
+    telemetryObserve(TM_TICK_LATENESS, tickLateness);
 
     seconds = (ntpEpochTime + ((millis() - ntpStart) / 1000)) % 60;
     if(prevSeconds == -1){
@@ -921,13 +1628,14 @@ void normalLoop(){
     if(!isMenuOpen){
       drawMainScreen();
     }
-    prev = millis();
+    updatePublishedState();
   }
 
   // Menu logic
 
   // Encoder press
   if (!digitalRead(SW)) {
+    StallScope stallScope(STALL_MENU);    // The callbacks wait for the encoder
     if (!isBacklightOn) {
       toggleBacklight();
       backlightTimer = millis();
@@ -942,26 +1650,69 @@ void normalLoop(){
   }
 }
 
+// The network is back while the access point is up
+void leaveAccessPointMode(){
+  notConnectedMode = false;
+  timeSetManually = false;    // NTP can fix the time set with the encoder
+  WiFi.mode(WIFI_STA);
+  startDiscovery();
+  lastTimeUpdate = -NTPUpdateMillisDelay;   // Sync as soon as possible
+  LOG_INFO("Connected, access point stopped\n");
+}
+
 void loop() {
-  if(notConnectedMode){
+  unsigned long loopStart = micros();
+  stallHeartbeat();
+  {
+    StallScope stallScope(STALL_SERVER);
     loopServer();
+  }
+  if((WiFi.getMode() & WIFI_AP) && WiFi.status() == WL_CONNECTED){
+    leaveAccessPointMode();
+  }
+
+  // Without the time the alarms can't work, it has to be set with the encoder or from the browser
+  if(notConnectedMode && ntpEpochTime == 0){
     // Button press
     if(!digitalRead(SW)){
+      StallScope stallScope(STALL_MENU);
       // TODO: Manually set the time
-      int* time = selectAlarmTime("Set current time");
+      int* time = selectAlarmTime(F("Set current time"));
       int h = time[0];
       int min = time[1];
-      delete time;
+      free(time);
 
       hours = h;
       minutes = min;
       seconds = 0;
+      // The date isn't known, the clock starts from a sunday (4/1/1970) for the alarms
+      day = 0;
+      ntpEpochTime = 3 * 86400 + h * 3600 + min * 60;
+      ntpStart = millis();
+      prevSeconds = 0;
+      alarmScheduleChanged = true;
       timeSetManually = true;
+      syncServer = 0;
       notConnectedMode = false;
     }
   }else{
     normalLoop();
   }
 
-  ArduinoOTA.handle();
+  {
+    StallScope stallScope(STALL_OTA);
+    ArduinoOTA.handle();
+  }
+  {
+    StallScope stallScope(STALL_FLASH);
+    loopEventLog();
+  }
+  loopNTPUpdate();
+  loopFleetSync();
+  loopSntpServer();
+  loopTelemetry();
+  consoleLoop();
+  loopMqtt();
+  loopLog();
+  telemetryObserve(TM_LOOP_MICROS, micros() - loopStart);
 }
\ No newline at end of file
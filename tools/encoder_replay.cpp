@@ -0,0 +1,140 @@
+/*
+
+  Host tool to check the encoder acceleration profiles (include/encoder.h) without the clock.
+
+  Build: g++ -std=c++11 -Iinclude -o encoder_replay tools/encoder_replay.cpp
+
+  encoder_replay trace <hours|minutes> <file>...   Replays recorded detents and prints the value after each one
+  encoder_replay bound <hours|minutes> [max]        Prints the fewest detents to reach every value from 0
+
+  A trace has a detent per line: the milliseconds since the previous detent and the direction,
+  1 or -1, e.g. "120 1". Lines starting with # are comments, except "# expect <value> <detents>":
+  the trace must end on that value within that many detents. Traces of typical spins
+  are in tools/traces, e.g. "encoder_replay trace minutes tools/traces/minutes_*.txt".
+  Exits with 1 if a trace misses its expectation, or if a value takes more than max detents.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <queue>
+#include <vector>
+
+#include "encoder.h"
+
+bool selectField(const char* name, const EncoderProfile*& profile, int& range){
+  if(strcmp(name, "hours") == 0){
+    profile = &hourProfile;
+    range = 24;
+  }else if(strcmp(name, "minutes") == 0){
+    profile = &minuteProfile;
+    range = 60;
+  }else{
+    return false;
+  }
+  return true;
+}
+
+int replayTrace(const EncoderProfile& profile, int range, const char* path){
+  FILE* f = fopen(path, "r");
+  if(!f){
+    fprintf(stderr, "Can't open %s\n", path);
+    return 1;
+  }
+  EncoderAccelerator accelerator(profile);
+  uint32_t time = 0;
+  int value = 0;
+  int detents = 0;
+  int expectedValue = -1;
+  int maxDetents = -1;
+  char line[64];
+  while(fgets(line, sizeof(line), f)){
+    unsigned int interval;
+    int direction;
+    if(sscanf(line, "# expect %d %d", &expectedValue, &maxDetents) == 2 || line[0] == '#' || sscanf(line, "%u %d", &interval, &direction) != 2){
+      continue;
+    }
+    time += interval;
+    int step = accelerator.step(time, direction > 0 ? 1 : -1);
+    value = applyEncoderStep(value, step, range);
+    detents++;
+    printf("%4u ms %+3d -> %02d\n", interval, step, value);
+  }
+  fclose(f);
+  printf("%s: %d detents, final value %02d\n", path, detents, value);
+  if(maxDetents >= 0 && (value != expectedValue || detents > maxDetents)){
+    printf("FAIL expected %02d within %d detents\n", expectedValue, maxDetents);
+    return 1;
+  }
+  return 0;
+}
+
+// Breadth first search on (value, direction of the last detent): after a detent in the same
+// direction the next one can be at any speed of the profile, otherwise it moves by one unit
+int printBound(const EncoderProfile& profile, int range, int max){
+  std::vector<int> distance(range * 3, -1);
+  std::queue<int> queue;
+  distance[0 * 3 + 1] = 0;
+  queue.push(0 * 3 + 1);
+
+  while(!queue.empty()){
+    int state = queue.front();
+    queue.pop();
+    int value = state / 3;
+    int lastDirection = state % 3 - 1;
+    for(int direction = -1; direction <= 1; direction += 2){
+      std::vector<int> units(1, 1);
+      if(direction == lastDirection){
+        for(int i = 0; i < profile.count; i++){
+          units.push_back(profile.speeds[i].units);
+        }
+      }
+      for(int u : units){
+        int next = applyEncoderStep(value, u * direction, range) * 3 + direction + 1;
+        if(distance[next] < 0){
+          distance[next] = distance[state] + 1;
+          queue.push(next);
+        }
+      }
+    }
+  }
+
+  int worst = 0;
+  for(int value = 0; value < range; value++){
+    int best = -1;
+    for(int direction = 0; direction < 3; direction++){
+      int d = distance[value * 3 + direction];
+      if(d >= 0 && (best < 0 || d < best)){
+        best = d;
+      }
+    }
+    printf("%02d: %d detents\n", value, best);
+    if(best > worst){
+      worst = best;
+    }
+  }
+  printf("At most %d detents\n", worst);
+  if(max >= 0 && worst > max){
+    printf("FAIL more than %d detents\n", max);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv){
+  const EncoderProfile* profile;
+  int range;
+  if(argc >= 4 && strcmp(argv[1], "trace") == 0 && selectField(argv[2], profile, range)){
+    int failed = 0;
+    for(int i = 3; i < argc; i++){
+      failed |= replayTrace(*profile, range, argv[i]);
+    }
+    return failed;
+  }
+  if((argc == 3 || argc == 4) && strcmp(argv[1], "bound") == 0 && selectField(argv[2], profile, range)){
+    return printBound(*profile, range, argc == 4 ? atoi(argv[3]) : -1);
+  }
+  fprintf(stderr, "Usage:\n  encoder_replay trace <hours|minutes> <file>...\n  encoder_replay bound <hours|minutes> [max]\n");
+  return 1;
+}
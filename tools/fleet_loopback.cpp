@@ -0,0 +1,322 @@
+/*
+
+  Host test of the LAN fleet sync (include/fleetpacket.h) with several clocks on the loopback multicast
+
+  Build: g++ -std=c++11 -Iinclude -o fleet_loopback tools/fleet_loopback.cpp
+
+  fleet_loopback [clocks]
+
+  Every clock has its own UDP socket in the multicast group of the firmware, bound to the
+  loopback interface, and runs the same FleetNode as the firmware with a virtual millis(),
+  so minutes of fleet pass in a moment. The test checks, with 4 clocks if not given:
+  - a single leader is elected and the others follow its time
+  - a config changed on a follower reaches every clock in one round
+  - packets signed with another key or tampered with are ignored
+  - a clock that joins late follows the leader and gets the config from its beacons
+  - after a split of the network the two leaders meet and the higher id steps down
+  - when the leader goes away another clock takes over
+  - a beacon recorded before a clock restarts doesn't move its time
+  Exits with 1 if a check fails.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "fleetpacket.h"
+
+#define FLEET_PORT 4210
+#define FLEET_MULTICAST "239.83.86.70"
+#define KEY "loopback test key"
+#define STEP_MILLIS 100
+
+struct Clock {
+  FleetNode node;
+  int fd = -1;
+  bool online = false;
+  bool isolated = false;     // Neither sends nor receives, as if the network was split
+  long long offset = 0;      // Milliseconds between its time and the true time
+  FleetConfig config = {};
+  unsigned int timesApplied = 0;
+};
+
+std::vector<Clock> clocks;
+unsigned long now = 0;                     // Virtual millis() of every clock
+const uint64_t trueStart = 1790000000000ULL;
+sockaddr_in group;
+int failures = 0;
+
+void check(bool condition, const char* what){
+  printf("%s %s\n", condition ? "ok  " : "FAIL", what);
+  failures += !condition;
+}
+
+uint64_t clockMillis(const Clock& clock){
+  return trueStart + now + clock.offset;
+}
+
+int openSocket(){
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(FLEET_PORT);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  ip_mreq membership = {};
+  inet_pton(AF_INET, FLEET_MULTICAST, &membership.imr_multiaddr);
+  inet_pton(AF_INET, "127.0.0.1", &membership.imr_interface);
+  if(bind(fd, (sockaddr*)&local, sizeof(local)) != 0 || setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0 ||
+     setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &membership.imr_interface, sizeof(membership.imr_interface)) != 0 ||
+     setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &yes, sizeof(yes)) != 0){
+    perror("Multicast on the loopback interface");
+    exit(2);
+  }
+  return fd;
+}
+
+void startClock(Clock& clock){
+  clock.fd = openSocket();
+  clock.online = true;
+  clock.node.start(now, rand());
+}
+
+void stopClock(Clock& clock){
+  close(clock.fd);
+  clock.online = false;
+}
+
+void send(const Clock& clock, const uint8_t* packet, size_t length){
+  if(clock.isolated){
+    return;
+  }
+  sendto(clock.fd, packet, length, 0, (sockaddr*)&group, sizeof(group));
+}
+
+void sendTime(Clock& clock, uint32_t nonce = 0){
+  uint64_t millis = clockMillis(clock);
+  uint8_t packet[FLEET_MAX_L];
+  send(clock, packet, fleetTimePacket(packet, KEY, clock.node.id, millis / 1000, millis % 1000, nonce));
+}
+
+void sendHello(Clock& clock){
+  uint8_t packet[FLEET_MAX_L];
+  send(clock, packet, fleetHelloPacket(packet, KEY, clock.node.id, clock.node.helloNonce()));
+}
+
+void sendConfig(Clock& clock){
+  uint8_t packet[FLEET_MAX_L];
+  send(clock, packet, fleetConfigPacket(packet, KEY, clock.node.id, clock.node.configVersion, clock.config));
+}
+
+// What loopFleetSync() does in the firmware
+void loopClock(Clock& clock){
+  uint8_t buffer[FLEET_MAX_L];
+  ssize_t length;
+  while((length = recv(clock.fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0){
+    FleetPacket packet;
+    if(clock.isolated || !fleetParsePacket(buffer, length, KEY, packet)){
+      continue;
+    }
+    if(packet.type == FLEET_TIME){
+      if(clock.node.acceptTime(packet, now)){
+        clock.offset = (long long)(packet.epoch * 1000ULL + packet.fraction) - (long long)(trueStart + now);
+        clock.timesApplied++;
+      }
+    }else if(packet.type == FLEET_HELLO){
+      if(clock.node.leader){
+        sendTime(clock, packet.nonce);
+      }
+    }else if(clock.node.acceptConfig(packet)){
+      clock.config = packet.config;
+    }
+  }
+
+  uint8_t send = clock.node.poll(now);
+  if(send & FLEET_SEND_TIME){
+    sendTime(clock);
+  }
+  if(send & FLEET_SEND_CONFIG){
+    sendConfig(clock);
+  }
+  if(send & FLEET_SEND_HELLO){
+    sendHello(clock);
+  }
+}
+
+// Moves the virtual time, every step waits a moment for the packets to go through the kernel
+void run(unsigned long millis){
+  for(unsigned long end = now + millis; now < end; now += STEP_MILLIS){
+    for(Clock& clock : clocks){
+      if(clock.online){
+        loopClock(clock);
+      }
+    }
+    usleep(200);
+  }
+}
+
+int leaders(){
+  int count = 0;
+  for(Clock& clock : clocks){
+    count += clock.online && clock.node.leader;
+  }
+  return count;
+}
+
+Clock* leader(){
+  for(Clock& clock : clocks){
+    if(clock.online && clock.node.leader){
+      return &clock;
+    }
+  }
+  return nullptr;
+}
+
+bool allFollow(uint32_t leader){
+  for(Clock& clock : clocks){
+    if(clock.online && clock.node.id != leader && (!clock.node.following(now) || clock.node.leaderId != leader)){
+      return false;
+    }
+  }
+  return true;
+}
+
+bool allHaveConfig(uint32_t version, uint8_t alarmHour){
+  for(Clock& clock : clocks){
+    if(clock.online && (clock.node.configVersion != version || clock.config.alarmTimes[1][0] != alarmHour)){
+      return false;
+    }
+  }
+  return true;
+}
+
+bool hmacVector(){
+  // RFC 4231 test case 2
+  static const uint8_t expected[32] = {
+    0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e, 0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+    0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83, 0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43
+  };
+  const char* data = "what do ya want for nothing?";
+  uint8_t mac[32];
+  fleetHmac("Jefe", (const uint8_t*)data, strlen(data), mac, sizeof(mac));
+  return memcmp(mac, expected, sizeof(mac)) == 0;
+}
+
+int main(int argc, char** argv){
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  int count = argc == 2 ? atoi(argv[1]) : 4;
+  if(count < 3 || count > 16){
+    fprintf(stderr, "Usage: fleet_loopback [clocks, 3-16]\n");
+    return 1;
+  }
+  group.sin_family = AF_INET;
+  group.sin_port = htons(FLEET_PORT);
+  inet_pton(AF_INET, FLEET_MULTICAST, &group.sin_addr);
+
+  check(hmacVector(), "HMAC-SHA256 matches RFC 4231");
+
+  clocks.resize(count);
+  for(int i = 0; i < count; i++){
+    clocks[i].node.id = 0x00A10000 + (count - i) * 7;
+    clocks[i].offset = (i + 1) * 1500;
+    memset(clocks[i].config.alarmTimes, 255, sizeof(clocks[i].config.alarmTimes));
+  }
+  Clock& late = clocks[count - 1];
+  for(int i = 0; i < count - 1; i++){
+    startClock(clocks[i]);
+  }
+
+  run(FLEET_LEADER_TIMEOUT + 16000 + 2 * FLEET_BEACON_MILLIS);
+  Clock* first = leader();
+  check(leaders() == 1, "A single leader");
+  check(first && allFollow(first->node.id), "The others follow it");
+  bool synced = first != nullptr;
+  for(int i = 0; synced && i < count - 1; i++){
+    synced &= llabs(clocks[i].offset - first->offset) <= STEP_MILLIS;     // A beacon can arrive in the next step
+  }
+  check(synced, "Every clock has the time of the leader");
+
+  // A change on a follower goes out right away, as fleetConfigChanged() does
+  Clock& editor = first == &clocks[0] ? clocks[1] : clocks[0];
+  editor.config.alarmTimes[1][0] = 7;
+  editor.config.alarmTimes[1][1] = 30;
+  editor.node.configVersion++;
+  sendConfig(editor);
+  run(STEP_MILLIS * 2);
+  check(allHaveConfig(editor.node.configVersion, 7), "A config changed on a follower reaches every clock in one round");
+
+  // Packets with another key, or changed on the way, are dropped
+  uint8_t packet[FLEET_MAX_L];
+  size_t length = fleetConfigPacket(packet, "another key", 1, 1000, editor.config);
+  send(editor, packet, length);
+  FleetConfig forged = editor.config;
+  forged.alarmTimes[1][0] = 4;
+  length = fleetConfigPacket(packet, KEY, 1, 1001, forged);
+  packet[14] ^= 1;
+  send(editor, packet, length);
+  run(STEP_MILLIS * 2);
+  check(allHaveConfig(editor.node.configVersion, 7), "Packets with another key or tampered with are ignored");
+
+  // The clock that joins late only hears the periodic config of the leader
+  startClock(late);
+  run((FLEET_CONFIG_EVERY + 1) * FLEET_BEACON_MILLIS);
+  check(late.config.alarmTimes[1][0] == 7 && late.node.configVersion == editor.node.configVersion, "A clock that joins late gets the config");
+  check(first && allFollow(first->node.id) && leaders() == 1, "It follows the leader");
+
+  // An isolated follower becomes a second leader, when the network is joined again the higher id steps down
+  Clock& split = first == &late ? clocks[0] : late;
+  split.isolated = true;
+  run(FLEET_LEADER_TIMEOUT + 16000);
+  check(leaders() == 2, "A split gives two leaders");
+  split.isolated = false;
+  uint32_t lower = split.node.id < first->node.id ? split.node.id : first->node.id;
+  run(2 * FLEET_BEACON_MILLIS);
+  check(leaders() == 1 && leader()->node.id == lower && allFollow(lower), "When they meet the higher id steps down");
+
+  // The leader goes away
+  Clock* gone = leader();
+  stopClock(*gone);
+  run(FLEET_LEADER_TIMEOUT + 16000 + 2 * FLEET_BEACON_MILLIS);
+  check(leaders() == 1 && leader() != gone && allFollow(leader()->node.id), "When the leader goes away another clock takes over");
+
+  // A beacon recorded a minute before a follower restarts is sent to it again while the leader is away
+  Clock* current = leader();
+  Clock* follower = nullptr;
+  for(Clock& clock : clocks){
+    if(clock.online && &clock != current){
+      follower = &clock;
+    }
+  }
+  uint64_t recordedMillis = clockMillis(*current);
+  uint8_t recorded[FLEET_MAX_L];
+  size_t recordedLength = fleetTimePacket(recorded, KEY, current->node.id, recordedMillis / 1000, recordedMillis % 1000);
+  run(60000);
+  stopClock(*follower);
+  uint32_t followerId = follower->node.id;
+  follower->node = FleetNode();
+  follower->node.id = followerId;
+  follower->node.configVersion = editor.node.configVersion;
+  startClock(*follower);
+  current->isolated = true;
+  long long offsetBefore = follower->offset;
+  send(*follower, recorded, recordedLength);
+  run(5 * STEP_MILLIS);
+  check(follower->offset == offsetBefore && !follower->node.following(now), "A beacon recorded before a restart is ignored");
+  current->isolated = false;
+  run(FLEET_BEACON_MILLIS + 2 * FLEET_HELLO_MILLIS);
+  check(follower->node.following(now) && llabs(follower->offset - current->offset) <= STEP_MILLIS, "The leader answers the HELLO and is followed again");
+
+  unsigned int applied = 0;
+  for(Clock& clock : clocks){
+    applied += clock.timesApplied;
+  }
+  printf("%d clocks, %lu s of virtual time, %u beacons applied\n", count, now / 1000, applied);
+  printf(failures ? "%d checks failed\n" : "All checks passed\n", failures);
+  return failures ? 1 : 0;
+}
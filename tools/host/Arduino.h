@@ -0,0 +1,153 @@
+#ifndef ARDUINO_H
+
+#define ARDUINO_H
+
+/*
+  Stand-in of the Arduino core for the host tools, with only what the headers they include use.
+  Time is virtual: it moves only with delay(), delayMicroseconds() and the I2C transfers of
+  Wire.h, so the tools measure the bus time the firmware would spend and not the host CPU.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define IRAM_ATTR
+#define PGM_P const char*
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define vsnprintf_P vsnprintf
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+
+// 5 bit values of binary.h, for the glyph bitmaps
+#define B00000 0
+#define B00001 1
+#define B00010 2
+#define B00011 3
+#define B00100 4
+#define B00101 5
+#define B00110 6
+#define B00111 7
+#define B01000 8
+#define B01001 9
+#define B01010 10
+#define B01011 11
+#define B01100 12
+#define B01101 13
+#define B01110 14
+#define B01111 15
+#define B10000 16
+#define B10001 17
+#define B10010 18
+#define B10011 19
+#define B10100 20
+#define B10101 21
+#define B10110 22
+#define B10111 23
+#define B11000 24
+#define B11001 25
+#define B11010 26
+#define B11011 27
+#define B11100 28
+#define B11101 29
+#define B11110 30
+#define B11111 31
+
+unsigned long hostMicros = 0;
+
+unsigned long micros(){
+  return hostMicros;
+}
+
+unsigned long millis(){
+  return hostMicros / 1000;
+}
+
+void delayMicroseconds(unsigned int us){
+  hostMicros += us;
+}
+
+void delay(unsigned long ms){
+  hostMicros += ms * 1000;
+}
+
+void yield(){}
+
+template<typename T> T min(T a, T b){
+  return b < a ? b : a;
+}
+
+class HostEsp {
+public:
+  uint32_t getChipId() {
+    return 0x00a1b2c3;
+  }
+};
+
+HostEsp ESP;
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t value) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while(size--){
+      written += write(*buffer++);
+    }
+    return written;
+  }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if(length < 0){
+      return 0;
+    }
+    return write((const uint8_t*)text, (size_t)length < sizeof(text) ? length : sizeof(text) - 1);
+  }
+
+  size_t println(const char* text) {
+    return write((const uint8_t*)text, strlen(text)) + write((const uint8_t*)"\r\n", 2);
+  }
+};
+
+// The serial port writes to stdout and is never full, nothing arrives on it
+class HostSerial : public Print {
+public:
+  int available() {
+    return 0;
+  }
+
+  int read() {
+    return -1;
+  }
+
+  size_t write(uint8_t value) override {
+    return fwrite(&value, 1, 1, stdout);
+  }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    return fwrite(buffer, 1, size, stdout);
+  }
+
+  int availableForWrite() {
+    return 128;
+  }
+};
+
+HostSerial Serial;
+
+#endif
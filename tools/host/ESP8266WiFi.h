@@ -0,0 +1,62 @@
+#ifndef ESP8266WIFI_H
+
+#define ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+
+/*
+  WiFi stand-in for the host tools: the computer is always the access point
+*/
+
+#define WIFI_STA 1
+#define WIFI_AP 2
+#define WL_CONNECTED 3
+
+// Like the one of the core, the address is kept in network order
+class IPAddress {
+public:
+  IPAddress(uint32_t address = 0) : address(address) {}
+
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    uint8_t bytes[4] = { a, b, c, d };
+    memcpy(&address, bytes, 4);
+  }
+
+  operator uint32_t() const {
+    return address;
+  }
+
+  uint8_t operator[](int index) const {
+    return ((const uint8_t*)&address)[index];
+  }
+
+  bool fromString(const char* text) {
+    in_addr parsed;
+    if(inet_pton(AF_INET, text, &parsed) != 1){
+      return false;
+    }
+    address = parsed.s_addr;
+    return true;
+  }
+
+private:
+  uint32_t address;
+};
+
+class HostWiFi {
+public:
+  int getMode() {
+    return WIFI_AP;
+  }
+
+  int status() {
+    return WL_CONNECTED;
+  }
+};
+
+HostWiFi WiFi;
+
+#include <WiFiClient.h>
+
+#endif
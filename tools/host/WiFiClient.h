@@ -0,0 +1,96 @@
+#ifndef WIFICLIENT_H
+
+#define WIFICLIENT_H
+
+#include <ESP8266WiFi.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+/*
+  TCP stand-in for the host tools on a real socket: connect() waits at most the timeout, like
+  the one of the core, and nothing else ever blocks
+*/
+
+class WiFiClient {
+public:
+  void setTimeout(unsigned long ms) {
+    timeout = ms;
+  }
+
+  int connect(IPAddress address, uint16_t port) {
+    stop();
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    sockaddr_in remote = {};
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(port);
+    remote.sin_addr.s_addr = address;
+    if(::connect(fd, (sockaddr*)&remote, sizeof(remote)) != 0){
+      pollfd p = { fd, POLLOUT, 0 };
+      int error = 0;
+      socklen_t length = sizeof(error);
+      if(poll(&p, 1, timeout) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0){
+        stop();
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  void setNoDelay(bool noDelay) {
+    int value = noDelay;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+  }
+
+  // False once the other side closed and everything it sent was read
+  uint8_t connected() {
+    if(fd < 0){
+      return 0;
+    }
+    uint8_t byte;
+    ssize_t received = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if(received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)){
+      stop();
+      return 0;
+    }
+    return 1;
+  }
+
+  int available() {
+    int length = 0;
+    return fd >= 0 && ioctl(fd, FIONREAD, &length) == 0 ? length : 0;
+  }
+
+  int read() {
+    uint8_t byte;
+    return fd >= 0 && recv(fd, &byte, 1, MSG_DONTWAIT) == 1 ? byte : -1;
+  }
+
+  // The socket buffer of the core is a TCP window, about what lwIP gives
+  size_t availableForWrite() {
+    return fd >= 0 ? 1460 : 0;
+  }
+
+  size_t write(const uint8_t* buffer, size_t length) {
+    ssize_t sent = fd >= 0 ? send(fd, buffer, length, MSG_DONTWAIT | MSG_NOSIGNAL) : -1;
+    return sent > 0 ? sent : 0;
+  }
+
+  void stop() {
+    if(fd >= 0){
+      close(fd);
+    }
+    fd = -1;
+  }
+
+private:
+  int fd = -1;
+  unsigned long timeout = 1000;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef WIFIUDP_H
+
+#define WIFIUDP_H
+
+#include <ESP8266WiFi.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*
+  UDP stand-in for the host tools on a real socket, never blocking like the one of the core
+*/
+
+class WiFiUDP {
+public:
+  uint8_t begin(uint16_t port) {
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    if(bind(fd, (sockaddr*)&local, sizeof(local)) != 0){
+      stop();
+      return 0;
+    }
+    return 1;
+  }
+
+  void stop() {
+    if(fd >= 0){
+      close(fd);
+    }
+    fd = -1;
+  }
+
+  // Size of the next packet, 0 if none arrived
+  int parsePacket() {
+    socklen_t length = sizeof(remote);
+    ssize_t received = fd < 0 ? -1 : recvfrom(fd, packet, sizeof(packet), MSG_DONTWAIT, (sockaddr*)&remote, &length);
+    packetLength = received > 0 ? received : 0;
+    position = 0;
+    return packetLength;
+  }
+
+  int read(uint8_t* buffer, size_t length) {
+    if(length > packetLength - position){
+      length = packetLength - position;
+    }
+    memcpy(buffer, packet + position, length);
+    position += length;
+    return length;
+  }
+
+  void flush() {
+    position = packetLength;
+  }
+
+  IPAddress remoteIP() const {
+    return IPAddress(remote.sin_addr.s_addr);
+  }
+
+  uint16_t remotePort() const {
+    return ntohs(remote.sin_port);
+  }
+
+  int beginPacket(IPAddress address, uint16_t port) {
+    destination = {};
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(port);
+    destination.sin_addr.s_addr = address;
+    outLength = 0;
+    return 1;
+  }
+
+  size_t write(const uint8_t* buffer, size_t length) {
+    if(length > sizeof(out) - outLength){
+      length = sizeof(out) - outLength;
+    }
+    memcpy(out + outLength, buffer, length);
+    outLength += length;
+    return length;
+  }
+
+  int endPacket() {
+    return sendto(fd, out, outLength, 0, (sockaddr*)&destination, sizeof(destination)) == (ssize_t)outLength;
+  }
+
+private:
+  int fd = -1;
+  uint8_t packet[1472];
+  size_t packetLength = 0;
+  size_t position = 0;
+  sockaddr_in remote = {};
+  sockaddr_in destination = {};
+  uint8_t out[1472];
+  size_t outLength = 0;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef WIRE_H
+
+#define WIRE_H
+
+#include <Arduino.h>
+
+/*
+  I2C stand-in for the host tools: it keeps the bytes of the last transmission and counts
+  them, and every transmission moves the virtual clock of Arduino.h by the time it takes on
+  the bus: start, address, data bytes with their ACK bit (9 clocks each) and stop.
+*/
+
+#define BUFFER_LENGTH 128
+
+class TwoWire {
+public:
+  void begin() {}
+
+  void setClock(uint32_t frequency) {
+    clock = frequency;
+  }
+
+  void beginTransmission(uint8_t) {
+    length = 0;
+  }
+
+  size_t write(const uint8_t* data, size_t size) {
+    if(length + size > BUFFER_LENGTH){
+      size = BUFFER_LENGTH - length;
+    }
+    memcpy(buffer + length, data, size);
+    length += size;
+    return size;
+  }
+
+  size_t write(uint8_t value) {
+    return write(&value, 1);
+  }
+
+  uint8_t endTransmission() {
+    unsigned long bits = 1 + (length + 1) * 9 + 1;
+    hostMicros += (bits * 1000000 + clock - 1) / clock;
+    bytes += length + 1;
+    transmissions++;
+    return 0;
+  }
+
+  uint32_t clock = 100000;
+  uint8_t buffer[BUFFER_LENGTH];
+  size_t length = 0;
+  unsigned long bytes = 0;
+  unsigned long transmissions = 0;
+};
+
+TwoWire Wire;
+
+#endif
@@ -0,0 +1,71 @@
+/*
+
+  Host benchmark of the LCD driver (include/lcd.h) on the I2C stand-in of tools/host/Wire.h
+
+  Build: g++ -std=c++11 -Iinclude -Itools/host -o lcd_bench tools/lcd_bench.cpp
+
+  lcd_bench [columns rows]
+
+  Runs the same benchmarkLCD() the firmware runs at boot with -DLCD_BENCHMARK, on a 20x4
+  display if not given, and then the same updates sent the LiquidCrystal_I2C way: a
+  transmission for every expander byte at 100 kHz, with the 50 us wait after every nibble.
+  The microseconds are bus time, the CPU time of the driver isn't counted.
+
+*/
+
+#define LCD_BENCHMARK
+
+#include <stdlib.h>
+
+#include "lcd.h"
+
+// A write of the expander for every byte, the nibble is latched by EN high and EN low
+void nibbleWrite(uint8_t value, uint8_t mode){
+  uint8_t nibbles[2] = { (uint8_t)(value & 0xF0), (uint8_t)((value << 4) & 0xF0) };
+  for(uint8_t nibble : nibbles){
+    uint8_t data[3] = { (uint8_t)(nibble | mode | LCD_BACKLIGHT), (uint8_t)(nibble | mode | LCD_BACKLIGHT | LCD_EN), (uint8_t)(nibble | mode | LCD_BACKLIGHT) };
+    for(uint8_t expander : data){
+      Wire.beginTransmission(0x27);
+      Wire.write(expander);
+      Wire.endTransmission();
+    }
+    delayMicroseconds(50);
+  }
+}
+
+void nibbleRow(uint8_t columns, uint8_t row){
+  static const uint8_t rowOffsets[] = { 0x00, 0x40, 0x14, 0x54 };
+  nibbleWrite(0x80 | rowOffsets[row], 0);
+  for(int i = 0; i < columns; i++){
+    nibbleWrite('A' + i % 26, LCD_RS);
+  }
+}
+
+int main(int argc, char** argv){
+  int columns = argc == 3 ? atoi(argv[1]) : 20;
+  int rows = argc == 3 ? atoi(argv[2]) : 4;
+  if(columns < 1 || columns > 40 || rows < 1 || rows > 4){
+    fprintf(stderr, "Usage: lcd_bench [columns rows]\n");
+    return 1;
+  }
+
+  BatchedLCD lcd(0x27, columns, rows);
+  lcd.init();
+  lcd.backlight();
+  unsigned long transmissions = Wire.transmissions;
+  benchmarkLCD(lcd, columns, rows);
+  printf("Transmissions for both updates and the clear: %lu\n", Wire.transmissions - transmissions);
+
+  Wire.setClock(100000);
+  unsigned long bytes = Wire.bytes;
+  unsigned long start = micros();
+  for(int r = 0; r < rows; r++){
+    nibbleRow(columns, r);
+  }
+  printf("\nNibble per transmission, full screen: %lu us, %lu bytes\n", micros() - start, Wire.bytes - bytes);
+  bytes = Wire.bytes;
+  start = micros();
+  nibbleRow(columns, 0);
+  printf("Nibble per transmission, single row: %lu us, %lu bytes\n", micros() - start, Wire.bytes - bytes);
+  return 0;
+}
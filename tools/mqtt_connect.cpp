@@ -0,0 +1,141 @@
+/*
+
+  Host test of the connection state machine of the MQTT client (include/mqtt.h) against the
+  stand-in broker of tools/mqtt_probe.cpp
+
+  Build: g++ -std=c++11 -Iinclude -Itools/host -o mqtt_connect tools/mqtt_connect.cpp
+
+  mqtt_connect [mqtt_probe binary] [port]
+
+  Starts "mqtt_probe broker" (./mqtt_probe on port 18830 if not given) and runs loopMqtt() on
+  the WiFi stand-ins of tools/host, with a virtual millis() that moves 100 ms per loop cycle,
+  so the backoff while the broker starts doesn't take real seconds. The test checks that:
+  - loopMqtt(false), the call of the alarm loop, never opens the connection
+  - loopMqtt(), the call of loop(), goes from offline to online and publishes the retained topics
+  - a line written on the cmd topic runs the console command, and the result with what the
+    command printed, cut at MQTT_RESULT_L, is published
+  - two commands sent together both run, each with its own result
+  - the client goes offline when the broker closes the connection
+  Exits with 1 if a check fails.
+
+*/
+
+#include <stdlib.h>
+#include <string>
+
+#define MQTT_HOST "127.0.0.1"
+
+uint16_t brokerPort = 18830;
+#define MQTT_PORT brokerPort
+
+#include "console.h"
+#include "mqtt.h"
+
+#define CYCLE_MILLIS 100
+#define MAX_CYCLES 200
+
+int failures = 0;
+int reports = 0;
+
+void check(bool condition, const char* what){
+  if(!condition){
+    printf("FAIL %s\n", what);
+    failures++;
+  }
+}
+
+// A cycle of loop(), or of the alarm loop if not reconnect, the broker gets a moment to answer
+void cycle(bool reconnect){
+  if(reconnect){
+    loopMqtt();
+  }else{
+    loopMqtt(false);
+  }
+  loopLog();
+  hostMicros += CYCLE_MILLIS * 1000UL;
+  usleep(10000);
+}
+
+// Runs cycles until done() or MAX_CYCLES, returns done()
+template<typename Done> bool runUntil(Done done, bool reconnect = true){
+  for(int i = 0; i < MAX_CYCLES && !done(); i++){
+    cycle(reconnect);
+  }
+  return done();
+}
+
+bool allPublished(){
+  for(int i = 0; i < MQTT_STATE_COUNT; i++){
+    if(mqttStateDirty[i]){
+      return false;
+    }
+  }
+  return mqttQueueCount == 0 && !mqttResultPending;
+}
+
+bool resultStarts(const char* text){
+  return strncmp(mqttResult, text, strlen(text)) == 0;
+}
+
+// Writes a line on the cmd topic through the stand-in broker
+void sendCommand(FILE* broker, const char* line){
+  fprintf(broker, "%s\n", line);
+  fflush(broker);
+}
+
+int main(int argc, char** argv){
+  setvbuf(stdout, nullptr, _IOLBF, 0);    // The broker writes on the same output
+  const char* probe = argc > 1 ? argv[1] : "./mqtt_probe";
+  if(argc > 2){
+    brokerPort = atoi(argv[2]);
+  }
+  char command[256];
+  snprintf(command, sizeof(command), "%s broker %u", probe, brokerPort);
+  FILE* broker = popen(command, "w");
+  if(!broker){
+    fprintf(stderr, "Can't start %s\n", command);
+    return 1;
+  }
+  hostMicros = 1000000;
+
+  // Prints more than a result can take
+  consoleCommand("report", "", [](int, char**){
+    for(int i = 0; i < 60; i++){
+      consoleOutput->printf("line_%02d %d\n", i, reports);
+    }
+    reports++;
+    return true;
+  });
+  setupMqtt(runConsoleLine);
+  check(mqttEnabled && mqttConnection == MQTT_OFFLINE, "Enabled and offline after setupMqtt");
+
+  for(int i = 0; i < 50; i++){
+    cycle(false);
+  }
+  check(mqttConnection == MQTT_OFFLINE, "No connection attempt while the alarm rings");
+
+  check(runUntil([](){ return mqttConnection == MQTT_ONLINE; }), "Online");
+  mqttSetState(MQTT_ALARM, "idle");
+  check(runUntil(allPublished), "Retained topics published");
+
+  // The broker subscribes the clock to the topic of the commands when it sees the SUBSCRIBE
+  sendCommand(broker, "report");
+  check(runUntil([](){ return reports == 1; }), "Command received");
+  check(resultStarts("OK report\nline_00 0\nline_01 0\n"), "Result with the output");
+  check(strlen(mqttResult) < MQTT_RESULT_L && strstr(mqttResult, "line_59") == nullptr, "Output cut");
+  check(runUntil(allPublished), "Result published");
+
+  sendCommand(broker, "nothing");
+  check(runUntil([](){ return resultStarts("ERR nothing\nERR unknown command"); }), "Unknown command");
+
+  sendCommand(broker, "report\nreport");
+  check(runUntil([](){ return reports == 3 && allPublished(); }), "Two commands together");
+  check(resultStarts("OK report\nline_00 2\n"), "Result of the second command");
+  check(mqttConnection == MQTT_ONLINE, "Still online");
+
+  pclose(broker);
+  check(runUntil([](){ return mqttConnection == MQTT_OFFLINE; }), "Offline when the broker goes away");
+
+  printf(failures ? "%d checks failed\n" : "All checks passed\n", failures);
+  return failures ? 1 : 0;
+}
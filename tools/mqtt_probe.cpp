@@ -0,0 +1,322 @@
+/*
+
+  Host tool to try the MQTT client of the clock (include/mqtt.h) with the packets of include/mqttpacket.h
+
+  Build: g++ -std=c++11 -Iinclude -o mqtt_probe tools/mqtt_probe.cpp
+
+  mqtt_probe selftest                              Builds packets and parses them back a byte at a time
+  mqtt_probe listen <broker IP> [port]             Prints everything the clocks publish on a broker (e.g. mosquitto)
+  mqtt_probe send <broker IP> <chip id> <command>  Sends a console command to a clock and prints the result
+  mqtt_probe broker [port]                         Stand-in broker for one clock: prints what it publishes and
+                                                   sends every line of stdin on its cmd topic
+
+  For the stand-in broker set MQTT_HOST in secrets.h to the IP of the computer.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define MQTT_PACKET_L 1024      // The results of the clock are longer than its packets
+
+#include "mqttpacket.h"
+
+bool sendAll(int fd, const uint8_t* buffer, size_t length){
+  while(length > 0){
+    ssize_t sent = send(fd, buffer, length, 0);
+    if(sent <= 0){
+      return false;
+    }
+    buffer += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+void printPublish(const MqttParser& parser){
+  const char* topic;
+  const char* payload;
+  size_t topicLength, payloadLength;
+  if(parser.publish(topic, topicLength, payload, payloadLength)){
+    printf("%s%.*s %.*s\n", parser.flags() & 1 ? "(retained) " : "", (int)topicLength, topic, (int)payloadLength, payload);
+    fflush(stdout);
+  }
+}
+
+// Reads until a packet is complete, false if the connection closed or timeout milliseconds passed
+bool readPacket(int fd, MqttParser& parser, int timeout){
+  uint8_t byte;
+  while(true){
+    pollfd p = { fd, POLLIN, 0 };
+    if(poll(&p, 1, timeout) <= 0 || recv(fd, &byte, 1, 0) != 1){
+      return false;
+    }
+    if(parser.feed(byte)){
+      return true;
+    }
+  }
+}
+
+int connectBroker(const char* address, int port){
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in broker = {};
+  broker.sin_family = AF_INET;
+  broker.sin_port = htons(port);
+  if(inet_pton(AF_INET, address, &broker.sin_addr) != 1 || connect(fd, (sockaddr*)&broker, sizeof(broker)) != 0){
+    fprintf(stderr, "Can't connect to %s:%d\n", address, port);
+    return -1;
+  }
+  uint8_t packet[MQTT_PACKET_L];
+  char clientId[32];
+  snprintf(clientId, sizeof(clientId), "mqtt_probe-%d", (int)getpid());
+  size_t length = mqttConnectPacket(packet, sizeof(packet), clientId, "mqtt_probe/status", "offline", nullptr, nullptr, 60);
+  MqttParser parser;
+  if(!sendAll(fd, packet, length) || !readPacket(fd, parser, 5000) || parser.type() != MQTT_CONNACK || parser.body()[1] != 0){
+    fprintf(stderr, "The broker refused the connection\n");
+    return -1;
+  }
+  return fd;
+}
+
+bool subscribe(int fd, const char* topic){
+  uint8_t packet[MQTT_PACKET_L];
+  return sendAll(fd, packet, mqttSubscribePacket(packet, sizeof(packet), 1, topic));
+}
+
+int listenBroker(const char* address, int port){
+  int fd = connectBroker(address, port);
+  if(fd < 0 || !subscribe(fd, "sveglia/#")){
+    return 1;
+  }
+  MqttParser parser;
+  while(readPacket(fd, parser, -1)){
+    if(parser.type() == MQTT_PUBLISH){
+      printPublish(parser);
+    }
+  }
+  return 0;
+}
+
+int sendCommand(const char* address, const char* chipId, const char* command){
+  int fd = connectBroker(address, 1883);
+  char topic[64];
+  snprintf(topic, sizeof(topic), "sveglia/%s/result", chipId);
+  if(fd < 0 || !subscribe(fd, topic)){
+    return 1;
+  }
+  uint8_t packet[MQTT_PACKET_L];
+  snprintf(topic, sizeof(topic), "sveglia/%s/cmd", chipId);
+  sendAll(fd, packet, mqttPublishPacket(packet, sizeof(packet), topic, command, false));
+  MqttParser parser;
+  while(readPacket(fd, parser, 10000)){
+    if(parser.type() == MQTT_PUBLISH){
+      printPublish(parser);
+      return 0;
+    }
+  }
+  fprintf(stderr, "No result in 10 s, is the clock connected?\n");
+  return 1;
+}
+
+// Accepts one clock at a time, answers like a broker and forwards stdin to the topic it subscribed
+int standInBroker(int port){
+  int server = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  if(bind(server, (sockaddr*)&local, sizeof(local)) != 0 || ::listen(server, 1) != 0){
+    fprintf(stderr, "Can't listen on port %d\n", port);
+    return 1;
+  }
+  setvbuf(stdin, nullptr, _IONBF, 0);    // fgets() must leave the next lines to poll()
+  printf("Waiting for a clock on port %d\n", port);
+  while(true){
+    // The end of stdin quits even with no clock connected
+    pollfd waiting[2] = { { server, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+    poll(waiting, 2, -1);
+    if(waiting[1].revents & (POLLIN | POLLHUP)){
+      char line[256];
+      if(!fgets(line, sizeof(line), stdin)){
+        return 0;
+      }
+      printf("No clock connected\n");
+      continue;
+    }
+    int fd = accept(server, nullptr, nullptr);
+    printf("Clock connected\n");
+    MqttParser parser;
+    std::string commandTopic;
+    bool open = true;
+    while(open){
+      pollfd p[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+      poll(p, 2, -1);
+      if(p[1].revents & (POLLIN | POLLHUP)){
+        char line[256];
+        if(!fgets(line, sizeof(line), stdin)){
+          return 0;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        uint8_t packet[MQTT_PACKET_L];
+        if(commandTopic.empty()){
+          printf("The clock didn't subscribe yet\n");
+        }else{
+          sendAll(fd, packet, mqttPublishPacket(packet, sizeof(packet), commandTopic.c_str(), line, false));
+        }
+      }
+      if(!(p[0].revents & (POLLIN | POLLHUP))){
+        continue;
+      }
+      uint8_t buffer[256];
+      ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+      if(length <= 0){
+        open = false;
+      }
+      for(ssize_t i = 0; i < length; i++){
+        if(!parser.feed(buffer[i])){
+          continue;
+        }
+        uint8_t reply[8];
+        switch(parser.type()){
+          case MQTT_CONNECT:
+            reply[0] = MQTT_CONNACK << 4; reply[1] = 2; reply[2] = 0; reply[3] = 0;
+            sendAll(fd, reply, 4);
+            break;
+          case MQTT_SUBSCRIBE:
+            commandTopic.assign((const char*)parser.body() + 4, (parser.body()[2] << 8) | parser.body()[3]);
+            printf("Subscribed to %s\n", commandTopic.c_str());
+            reply[0] = MQTT_SUBACK << 4; reply[1] = 3; reply[2] = parser.body()[0]; reply[3] = parser.body()[1]; reply[4] = 0;
+            sendAll(fd, reply, 5);
+            break;
+          case MQTT_PINGREQ:
+            sendAll(fd, reply, mqttEmptyPacket(reply, sizeof(reply), MQTT_PINGRESP));
+            break;
+          case MQTT_PUBLISH:
+            printPublish(parser);
+            break;
+          case MQTT_DISCONNECT:
+            open = false;
+            break;
+        }
+      }
+    }
+    close(fd);
+    printf("Clock disconnected\n");
+  }
+}
+
+int failures = 0;
+
+void check(bool condition, const char* what){
+  if(!condition){
+    printf("FAIL %s\n", what);
+    failures++;
+  }
+}
+
+// Feeds the packet a byte at a time, it must be complete only at the last one
+bool parseBack(MqttParser& parser, const uint8_t* packet, size_t length){
+  for(size_t i = 0; i < length; i++){
+    if(parser.feed(packet[i]) != (i == length - 1)){
+      return false;
+    }
+  }
+  return true;
+}
+
+int selftest(){
+  uint8_t packet[MQTT_PACKET_L];
+  MqttParser parser;
+
+  size_t length = mqttConnectPacket(packet, sizeof(packet), "sveglia-00a1b2c3", "sveglia/00a1b2c3/status", "offline", "user", "pass", 60);
+  check(length == 2 + 10 + 18 + 25 + 9 + 6 + 6, "CONNECT length");
+  check(packet[0] == 0x10 && packet[9] == 0xE6, "CONNECT header and flags");
+  check(parseBack(parser, packet, length) && parser.type() == MQTT_CONNECT, "CONNECT parsed");
+
+  // The remaining length takes one more byte over 127
+  for(size_t payloadLength : { 0, 100, 121, 122, 200 }){
+    std::string payload(payloadLength, 'x');
+    length = mqttPublishPacket(packet, sizeof(packet), "a/b", payload.c_str(), true);
+    check(length == 1 + mqttLengthSize(5 + payloadLength) + 5 + payloadLength, "PUBLISH length");
+    const char* topic = nullptr;
+    const char* body = nullptr;
+    size_t topicLength = 0, bodyLength = 0;
+    check(parseBack(parser, packet, length) && parser.publish(topic, topicLength, body, bodyLength), "PUBLISH parsed");
+    check(topicLength == 3 && strncmp(topic, "a/b", 3) == 0 && bodyLength == payloadLength && (parser.flags() & 1), "PUBLISH topic, payload and retain");
+  }
+  check(mqttLengthSize(127) == 1 && mqttLengthSize(128) == 2 && mqttLengthSize(16383) == 2 && mqttLengthSize(16384) == 3, "Remaining length size");
+
+  std::string big(MQTT_PACKET_L, 'x');
+  check(mqttPublishPacket(packet, sizeof(packet), "a", big.c_str(), false) == 0, "PUBLISH bigger than the buffer");
+
+  // A packet longer than the buffer is skipped and the next one is parsed
+  uint8_t longPacket[MQTT_PACKET_L * 2];
+  std::string longPayload(MQTT_PACKET_L + 10, 'y');
+  length = mqttPublishPacket(longPacket, sizeof(longPacket), "a", longPayload.c_str(), false);
+  bool completed = false;
+  for(size_t i = 0; i < length; i++){
+    completed |= parser.feed(longPacket[i]);
+  }
+  check(!completed, "Long packet skipped");
+  length = mqttEmptyPacket(packet, sizeof(packet), MQTT_PINGRESP);
+  check(parseBack(parser, packet, length) && parser.type() == MQTT_PINGRESP, "PINGRESP after a long packet");
+
+  // The longest remaining length takes 4 bytes, here 2097152 bytes of a PUBLISH that is skipped
+  const uint8_t fourBytes[] = { MQTT_PUBLISH << 4, 0x80, 0x80, 0x80, 0x01 };
+  completed = false;
+  for(uint8_t byte : fourBytes){
+    completed |= parser.feed(byte);
+  }
+  for(size_t i = 0; i < 2097152; i++){
+    completed |= parser.feed('z');
+  }
+  check(!completed && !parser.malformed(), "Remaining length of 4 bytes");
+  length = mqttEmptyPacket(packet, sizeof(packet), MQTT_PINGRESP);
+  check(parseBack(parser, packet, length) && parser.type() == MQTT_PINGRESP, "PINGRESP after a 4 byte length");
+
+  // A fifth byte isn't MQTT, nothing is parsed until reset()
+  const uint8_t fiveBytes[] = { MQTT_PUBLISH << 4, 0xFF, 0xFF, 0xFF, 0xFF, 0x01 };
+  for(uint8_t byte : fiveBytes){
+    parser.feed(byte);
+  }
+  completed = false;
+  for(size_t i = 0; i < length; i++){
+    completed |= parser.feed(packet[i]);
+  }
+  check(!completed && parser.malformed(), "Remaining length of 5 bytes");
+  parser.reset();
+  check(parseBack(parser, packet, length) && parser.type() == MQTT_PINGRESP, "PINGRESP after reset()");
+
+  length = mqttSubscribePacket(packet, sizeof(packet), 1, "sveglia/00a1b2c3/cmd");
+  check(length == 2 + 2 + 22 + 1 && packet[0] == 0x82, "SUBSCRIBE");
+
+  printf(failures ? "%d checks failed\n" : "All checks passed\n", failures);
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv){
+  setvbuf(stdout, nullptr, _IOLBF, 0);    // The output can go to a pipe
+  if(argc == 2 && strcmp(argv[1], "selftest") == 0){
+    return selftest();
+  }
+  if((argc == 3 || argc == 4) && strcmp(argv[1], "listen") == 0){
+    return listenBroker(argv[2], argc == 4 ? atoi(argv[3]) : 1883);
+  }
+  if(argc == 5 && strcmp(argv[1], "send") == 0){
+    return sendCommand(argv[2], argv[3], argv[4]);
+  }
+  if((argc == 2 || argc == 3) && strcmp(argv[1], "broker") == 0){
+    return standInBroker(argc == 3 ? atoi(argv[2]) : 1883);
+  }
+  fprintf(stderr, "Usage:\n  mqtt_probe selftest\n  mqtt_probe listen <broker IP> [port]\n  mqtt_probe send <broker IP> <chip id> <command>\n  mqtt_probe broker [port]\n");
+  return 1;
+}
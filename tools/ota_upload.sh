@@ -0,0 +1,77 @@
+# Resumable OTA upload: ./tools/ota_upload.sh <firmware.bin> [host] [chunk size]
+# The image is compressed with gzip before being sent, a dropped connection resumes from the last byte received
+# The credentials of the web server come from SVEGLIA_PASSWORD (and SVEGLIA_USER if it isn't "sveglia")
+# It gives up with exit status 1 after 10 attempts in a row that don't move the upload forward
+
+firmware=$1
+host=${2:-espsveglia.local}
+chunk=${3:-16384}
+
+if ! [ -e "$firmware" ]; then
+    echo "Could not find firmware"
+    exit 1
+fi
+if [ -z "$SVEGLIA_PASSWORD" ]; then
+    echo "Set SVEGLIA_PASSWORD to the password of the web server"
+    exit 1
+fi
+auth="${SVEGLIA_USER:-sveglia}:$SVEGLIA_PASSWORD"
+
+image=$(mktemp)
+gzip -9 -c "$firmware" > "$image"
+size=$(stat -c %s "$image")
+md5=$(md5sum "$image" | cut -d ' ' -f 1)
+
+offset=0
+failures=0
+while [ "$offset" -lt "$size" ]; do
+    if [ "$failures" -ge 10 ]; then
+        echo "The upload doesn't move forward, giving up"
+        rm -f "$image" "$image.chunk" "$image.status"
+        exit 1
+    fi
+    tail -c +$((offset + 1)) "$image" | head -c "$chunk" > "$image.chunk"
+    curl -k -s -u "$auth" -o /dev/null -F "chunk=@$image.chunk" "https://$host/ota?offset=$offset&size=$size&md5=$md5"
+    last=$((offset + chunk >= size))
+
+    # Ask the clock how much it really received
+    rm -f "$image.status"
+    code=$(curl -k -s -u "$auth" -o "$image.status" -w "%{http_code}" "https://$host/ota")
+    if [ "$code" = "401" ]; then
+        echo "Wrong user or password"
+        rm -f "$image" "$image.chunk" "$image.status"
+        exit 1
+    fi
+    status=$(cat "$image.status" 2>/dev/null)
+    case "$status" in
+        [0-9]*" "[0-9]*) ;;
+        *) status="" ;;
+    esac
+    if [ -z "$status" ]; then
+        echo "The clock is unreachable, retrying..."
+        failures=$((failures + 1))
+        sleep 2
+        continue
+    fi
+    if [ "${status##* }" = "0" ]; then
+        if [ "$last" = "1" ]; then
+            # Restarted with the new firmware
+            break
+        fi
+        echo "The clock restarted, starting again"
+        failures=$((failures + 1))
+        offset=0
+        continue
+    fi
+    if [ "${status%% *}" -gt "$offset" ]; then
+        failures=0
+    else
+        # The chunk was refused, e.g. Update.begin failed
+        failures=$((failures + 1))
+    fi
+    offset=${status%% *}
+    echo "$offset / $size"
+done
+
+rm -f "$image" "$image.chunk" "$image.status"
+echo "Done"
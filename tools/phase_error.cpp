@@ -0,0 +1,226 @@
+/*
+
+  Host harness that measures how far from the true second boundaries the clock changes the displayed second
+
+  Build: g++ -std=c++11 -Iinclude -o phase_error tools/phase_error.cpp
+
+  phase_error [-h hours] [-d drift ppm] [-s seed] [-b bound ms]
+
+  Simulates the loop of the clock for 24 hours if not given, with a crystal off by 50 ppm,
+  loop cycles of 2-8 ms and one in ten thousand of 50-300 ms (a web page about once a
+  minute), and the non-blocking sync of include/ntp.h every 5 minutes: 4 samples, each with
+  5-40 ms of delay in every direction chosen independently, 5% of them lost. The answers are
+  seen at the first loop cycle after they arrive and go through ntpParseAnswer(), the ticks
+  through nextSecondTick(), as on the clock.
+  For every second drawn the phase error is the true time when it's drawn minus the start of
+  that second. Seconds never drawn are counted, and so are the ticks that draw nothing since
+  a correction moved the boundary a little later (the firmware only redraws a new second).
+  The same run is done the way the firmware worked with NTPClient, whole seconds and a redraw
+  every 1000 ms, for comparison. Exits with 1 if a second is skipped or the 99th percentile
+  of the phase error is over the bound, 50 ms if not given.
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "ntppacket.h"
+
+#define NTP_TIMEOUT_MICROS 1000000ULL
+#define NTP_SAMPLES 4
+#define NTP_EVERY_MICROS (5 * 60 * 1000000ULL)
+
+std::mt19937 rng;
+
+double uniform(double min, double max){
+  return std::uniform_real_distribution<double>(min, max)(rng);
+}
+
+struct Stats {
+  std::vector<double> errors;
+  unsigned long skipped = 0;
+  unsigned long same = 0;        // Ticks that found the same second
+  uint32_t lastSecond = 0;
+
+  void tick(uint32_t second, double error){
+    if(lastSecond != 0){
+      if(second == lastSecond){
+        same++;
+        return;
+      }
+      skipped += second - lastSecond - 1;
+    }
+    lastSecond = second;
+    errors.push_back(error);
+  }
+
+  double percentile(double p){
+    return errors[std::min(errors.size() - 1, (size_t)(p * errors.size()))];
+  }
+
+  void print(const char* name){
+    std::sort(errors.begin(), errors.end(), [](double a, double b){ return fabs(a) < fabs(b); });
+    double sum = 0;
+    for(double error : errors){
+      sum += fabs(error);
+    }
+    printf("%-28s ticks %7zu  mean %7.2f ms  p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms  skipped %lu  same second %lu\n", name, errors.size(),
+           sum / errors.size(), fabs(percentile(0.5)), fabs(percentile(0.99)), fabs(errors.back()), skipped, same);
+  }
+};
+
+// An NTP server with the true time, the packets come back after the delay of the two directions
+struct Exchange {
+  bool lost = false;
+  uint64_t arrival = 0;             // True microseconds when the answer arrives
+  uint8_t answer[NTP_PACKET_L];
+};
+
+void writeTimestamp(uint8_t* p, uint64_t unixMicros){
+  uint32_t seconds = unixMicros / 1000000 + NTP_UNIX_OFFSET;
+  uint32_t fraction = ((unixMicros % 1000000) << 32) / 1000000;
+  for(int i = 0; i < 4; i++){
+    p[i] = seconds >> (24 - i * 8);
+    p[i + 4] = fraction >> (24 - i * 8);
+  }
+}
+
+void sendRequest(Exchange& exchange, const uint8_t* request, uint64_t trueMicros){
+  double up = uniform(5000, 40000);
+  double down = uniform(5000, 40000);
+  uint64_t received = trueMicros + up;
+  uint64_t transmitted = received + uniform(20, 500);
+  memset(exchange.answer, 0, sizeof(exchange.answer));
+  exchange.answer[0] = 0x24;      // Version 4, server mode
+  exchange.answer[1] = 2;
+  memcpy(exchange.answer + 24, request + 40, 8);
+  writeTimestamp(exchange.answer + 32, received);
+  writeTimestamp(exchange.answer + 40, transmitted);
+  exchange.arrival = transmitted + down;
+  exchange.lost = uniform(0, 1) < 0.05;
+}
+
+int main(int argc, char** argv){
+  double hours = 24;
+  double drift = 50;
+  unsigned int seed = 1;
+  double bound = 50;
+  int option;
+  while((option = getopt(argc, argv, "h:d:s:b:")) != -1){
+    if(option == 'h'){
+      hours = atof(optarg);
+    }else if(option == 'd'){
+      drift = atof(optarg);
+    }else if(option == 's'){
+      seed = atoi(optarg);
+    }else if(option == 'b'){
+      bound = atof(optarg);
+    }else{
+      fprintf(stderr, "Usage: phase_error [-h hours] [-d drift ppm] [-s seed] [-b bound ms]\n");
+      return 1;
+    }
+  }
+  rng.seed(seed);
+
+  // True time in microseconds since 1970, the local clock starts elsewhere and runs fast or slow
+  const uint64_t trueStart = 1790000000ULL * 1000000 + (uint64_t)uniform(0, 1000000);
+  const uint64_t localStart = (uint64_t)uniform(0, 1e9);
+  uint64_t trueMicros = trueStart;
+  auto localMicros = [&](){ return localStart + (uint64_t)((trueMicros - trueStart) * (1 + drift / 1e6)); };
+  auto localMillis = [&](){ return (unsigned long)(localMicros() / 1000); };
+
+  // The firmware
+  uint32_t epoch = 0;
+  unsigned long start = 0;
+  unsigned long nextTick = 0;
+  Exchange exchange;
+  int samplesLeft = 0;
+  bool found = false;
+  NtpSample best = {};
+  uint32_t nonce = 0;
+  unsigned long sent = 0;
+  uint64_t nextSync = trueMicros;
+  Stats aligned;
+
+  // The firmware with NTPClient
+  uint32_t oldEpoch = 0;
+  unsigned long oldUpdate = 0;
+  unsigned long oldPrevious = 0;
+  Stats unaligned;
+
+  auto sendSample = [&](){
+    uint8_t request[NTP_PACKET_L];
+    nonce = rng();
+    ntpRequestPacket(request, nonce);
+    sent = localMicros();
+    sendRequest(exchange, request, trueMicros);
+  };
+
+  const uint64_t end = trueStart + (uint64_t)(hours * 3600e6);
+  while(trueMicros < end){
+    trueMicros += uniform(0, 1) < 0.0001 ? uniform(50000, 300000) : uniform(2000, 8000);
+
+    if(trueMicros >= nextSync && samplesLeft == 0){
+      samplesLeft = NTP_SAMPLES;
+      found = false;
+      sendSample();
+      nextSync = trueMicros + NTP_EVERY_MICROS;
+
+      // NTPClient: the whole seconds the server sent, as if the answer took 5-40 ms to arrive now
+      oldEpoch = (trueMicros - (uint64_t)uniform(5000, 40000)) / 1000000;
+      oldUpdate = localMillis();
+    }
+
+    // ntpPoll()
+    if(samplesLeft > 0){
+      bool next = false;
+      if(!exchange.lost && trueMicros >= exchange.arrival){
+        NtpSample sample;
+        if(ntpParseAnswer(exchange.answer, nonce, sent, localMicros(), sample)){
+          sample.local = localMillis();
+          if(!found || sample.delay < best.delay){
+            best = sample;
+            found = true;
+          }
+        }
+        next = true;
+      }else if(localMicros() - sent >= NTP_TIMEOUT_MICROS){
+        next = true;
+      }
+      if(next && --samplesLeft > 0){
+        sendSample();
+      }else if(next && found){
+        // setLocalTime()
+        unsigned long fraction = best.millis + (localMillis() - best.local);
+        epoch = best.seconds + fraction / 1000;
+        start = localMillis() - fraction % 1000;
+      }
+    }
+
+    if(epoch != 0 && (long)(localMillis() - nextTick) >= 0){
+      unsigned long lateness;
+      nextTick = nextSecondTick(localMillis(), start, lateness);
+      uint32_t second = epoch + (localMillis() - start) / 1000;
+      aligned.tick(second, (trueMicros / 1000.0) - second * 1000.0);
+    }
+    if(oldEpoch != 0 && localMillis() - oldPrevious > 1000){
+      oldPrevious = localMillis();
+      uint32_t second = oldEpoch + (localMillis() - oldUpdate) / 1000;
+      unaligned.tick(second, (trueMicros / 1000.0) - second * 1000.0);
+    }
+  }
+
+  printf("%.1f hours, drift %.0f ppm, seed %u\n", hours, drift, seed);
+  aligned.print("Aligned ticks, NTP fraction");
+  unaligned.print("1000 ms redraw, NTPClient");
+  if(aligned.skipped > 0 || fabs(aligned.percentile(0.99)) > bound){
+    printf("Skipped seconds or 99th percentile over %.0f ms\n", bound);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+/*
+
+  Host check that drawing the clock screen (include/screen.h) never uses the heap
+
+  Build: g++ -std=c++11 -Iinclude -Itools/host -o render_alloc tools/render_alloc.cpp
+
+  render_alloc
+
+  Draws a frame for every second of a day, with and without network, next alarm and access
+  point, on the LCD driver and the I2C stand-in of tools/host. malloc, calloc, realloc and
+  operator new are counted while a frame is drawn, the check fails if a frame allocated.
+  The counter wraps the allocator of glibc.
+
+*/
+
+#include <stdlib.h>
+#include <new>
+
+#include "screen.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+extern "C" void __libc_free(void* pointer);
+
+bool counting = false;
+unsigned long allocations = 0;
+
+extern "C" void* malloc(size_t size){
+  allocations += counting;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size){
+  allocations += counting;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size){
+  allocations += counting;
+  return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void* pointer){
+  __libc_free(pointer);
+}
+
+// Not every libstdc++ sends operator new to malloc
+void* operator new(size_t size){
+  allocations += counting;
+  void* pointer = __libc_malloc(size ? size : 1);
+  if(!pointer){
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+  __libc_free(pointer);
+}
+
+int main(){
+  lcd.init();
+  lcd.backlight();
+  const uint8_t apAddress[4] = { 192, 168, 4, 1 };
+  unsigned long frames = 0;
+  unsigned long allocatingFrames = 0;
+  unsigned long total = 0;
+
+  for(int variant = 0; variant < 4; variant++){
+    int nextAlarm[3] = { variant & 1 ? 3 : 255, 6, 45 };
+    for(long second = 0; second < 86400; second++){
+      counting = true;
+      allocations = 0;
+      drawClockScreen(second / 3600, second / 60 % 60, second % 60, variant & 2, nextAlarm, second & 1, variant & 2 ? nullptr : apAddress);
+      counting = false;
+      frames++;
+      total += allocations;
+      if(allocations){
+        allocatingFrames++;
+      }
+    }
+  }
+
+  printf("%lu frames, %lu allocations, %lu frames allocated\n", frames, total, allocatingFrames);
+  printf("%lu I2C bytes per frame, %lu CGRAM uploads\n", Wire.bytes / frames, glyphs.getTotalUploads());
+  return allocatingFrames ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/*
+
+  Host tool to read, compare and create the settings snapshots of the clock.
+  It uses the same serialization code as the firmware (include/snapshot.h).
+
+  Build: g++ -std=c++11 -Iinclude -o snapshot_tool tools/snapshot_tool.cpp
+
+  snapshot_tool show <file>
+  snapshot_tool diff <file1> <file2>
+  snapshot_tool generate <out> [base=<file>] [<day>=HH:MM|off] [next=<day>,HH:MM|off] [sound=N]
+                               [utcOffset=SECONDS] [legalHour=0|1] [ssid=SSID] [passwd=PASSWORD]
+
+  Days: sunday, monday, tuesday, wednesday, thursday, friday, saturday
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "snapshot.h"
+#include "melodies.h"
+
+const char* daysOfTheWeek[7] = { "sunday", "monday", "tuesday", "wednesday", "thursday", "friday", "saturday" };
+
+int dayIndex(const std::string& name){
+  for(int i = 0; i < 7; i++){
+    if(name == daysOfTheWeek[i]){
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool readSnapshot(const char* path, SettingsSnapshot& snapshot){
+  FILE* file = fopen(path, "rb");
+  if(!file){
+    fprintf(stderr, "Could not open %s\n", path);
+    return false;
+  }
+  uint8_t buffer[SNAPSHOT_MAX_SIZE + 1];
+  size_t length = fread(buffer, 1, sizeof(buffer), file);
+  fclose(file);
+  if(!deserializeSnapshot(buffer, length, snapshot)){
+    fprintf(stderr, "%s is not a valid snapshot\n", path);
+    return false;
+  }
+  return true;
+}
+
+bool writeSnapshot(const char* path, const SettingsSnapshot& snapshot){
+  uint8_t buffer[SNAPSHOT_MAX_SIZE];
+  size_t length = serializeSnapshot(snapshot, buffer, sizeof(buffer));
+  FILE* file = fopen(path, "wb");
+  if(!file || fwrite(buffer, 1, length, file) != length){
+    fprintf(stderr, "Could not write %s\n", path);
+    if(file) fclose(file);
+    return false;
+  }
+  fclose(file);
+  return true;
+}
+
+std::string formatTime(uint8_t h, uint8_t min){
+  if(h == 255){
+    return "off";
+  }
+  char buffer[8];
+  snprintf(buffer, sizeof(buffer), "%02d:%02d", h, min);
+  return buffer;
+}
+
+// One "key=value" line for every setting, so show and diff share the same output
+std::string settingLine(const SettingsSnapshot& s, int index){
+  char buffer[128];
+  if(index < 7){
+    snprintf(buffer, sizeof(buffer), "%s=%s", daysOfTheWeek[index], formatTime(s.alarmTimes[index][0], s.alarmTimes[index][1]).c_str());
+  }else if(index == 7){
+    if(s.nextDay == -1){
+      snprintf(buffer, sizeof(buffer), "next=off");
+    }else{
+      snprintf(buffer, sizeof(buffer), "next=%s,%s", daysOfTheWeek[s.nextDay], formatTime(s.nextAlarm[0], s.nextAlarm[1]).c_str());
+    }
+  }else if(index == 8){
+    snprintf(buffer, sizeof(buffer), "sound=%d", s.selectedAlarm);
+  }else if(index == 9){
+    snprintf(buffer, sizeof(buffer), "utcOffset=%d", (int)s.utcOffset);
+  }else if(index == 10){
+    snprintf(buffer, sizeof(buffer), "legalHour=%d", s.considerLegalHour);
+  }else if(index == 11){
+    snprintf(buffer, sizeof(buffer), "ssid=%s", s.hasNetwork ? s.ssid : "");
+  }else{
+    snprintf(buffer, sizeof(buffer), "passwd=%s", s.hasNetwork ? s.passwd : "");
+  }
+  return buffer;
+}
+
+const int settingLines = 13;
+
+// The whole value must be a number between min and max, atoi would take "abc" as 0
+bool parseNumber(const std::string& value, long min, long max, long& number){
+  char* end;
+  number = strtol(value.c_str(), &end, 10);
+  return !value.empty() && *end == '\0' && number >= min && number <= max;
+}
+
+bool parseTime(const std::string& value, uint8_t& h, uint8_t& min){
+  long hour, minute;
+  if(value == "off"){
+    h = min = 255;
+    return true;
+  }
+  size_t colon = value.find(':');
+  if(colon == std::string::npos || !parseNumber(value.substr(0, colon), 0, 23, hour) || !parseNumber(value.substr(colon + 1), 0, 59, minute)){
+    return false;
+  }
+  h = hour;
+  min = minute;
+  return true;
+}
+
+bool applySetting(SettingsSnapshot& s, const std::string& arg){
+  size_t separator = arg.find('=');
+  if(separator == std::string::npos){
+    return false;
+  }
+  std::string key = arg.substr(0, separator);
+  std::string value = arg.substr(separator + 1);
+
+  int day = dayIndex(key);
+  if(day != -1){
+    return parseTime(value, s.alarmTimes[day][0], s.alarmTimes[day][1]);
+  }else if(key == "next"){
+    if(value == "off"){
+      s.nextDay = -1;
+      s.nextAlarm[0] = s.nextAlarm[1] = 255;
+      return true;
+    }
+    size_t comma = value.find(',');
+    if(comma == std::string::npos || (day = dayIndex(value.substr(0, comma))) == -1){
+      return false;
+    }
+    s.nextDay = day;
+    return parseTime(value.substr(comma + 1), s.nextAlarm[0], s.nextAlarm[1]);
+  }
+  long number;
+  if(key == "sound" && parseNumber(value, 0, ALARM_MELODIES - 1, number)){
+    s.selectedAlarm = number;
+  }else if(key == "utcOffset" && parseNumber(value, -14 * 3600, 14 * 3600, number)){
+    s.utcOffset = number;
+  }else if(key == "legalHour" && parseNumber(value, 0, 1, number)){
+    s.considerLegalHour = number;
+  }else if(key == "ssid" && value.length() < SNAPSHOT_SSID_L){
+    s.hasNetwork = true;
+    snprintf(s.ssid, sizeof(s.ssid), "%s", value.c_str());
+  }else if(key == "passwd" && value.length() < SNAPSHOT_PASSWD_L){
+    snprintf(s.passwd, sizeof(s.passwd), "%s", value.c_str());
+  }else{
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv){
+  if(argc >= 3 && std::string(argv[1]) == "show"){
+    SettingsSnapshot snapshot;
+    if(!readSnapshot(argv[2], snapshot)){
+      return 1;
+    }
+    for(int i = 0; i < settingLines; i++){
+      printf("%s\n", settingLine(snapshot, i).c_str());
+    }
+    return 0;
+  }
+
+  if(argc >= 4 && std::string(argv[1]) == "diff"){
+    SettingsSnapshot a, b;
+    if(!readSnapshot(argv[2], a) || !readSnapshot(argv[3], b)){
+      return 1;
+    }
+    int differences = 0;
+    for(int i = 0; i < settingLines; i++){
+      std::string lineA = settingLine(a, i), lineB = settingLine(b, i);
+      if(lineA != lineB){
+        printf("- %s\n+ %s\n", lineA.c_str(), lineB.c_str());
+        differences++;
+      }
+    }
+    return differences ? 2 : 0;
+  }
+
+  if(argc >= 3 && std::string(argv[1]) == "generate"){
+    SettingsSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    memset(snapshot.alarmTimes, 255, sizeof(snapshot.alarmTimes));
+    snapshot.nextAlarm[0] = snapshot.nextAlarm[1] = 255;
+    snapshot.nextDay = -1;
+    snapshot.utcOffset = 3600;
+    snapshot.considerLegalHour = 1;
+
+    for(int i = 3; i < argc; i++){
+      std::string arg = argv[i];
+      if(arg.compare(0, 5, "base=") == 0){
+        if(!readSnapshot(arg.c_str() + 5, snapshot)){
+          return 1;
+        }
+        if(!validSnapshotSettings(snapshot, ALARM_MELODIES)){
+          fprintf(stderr, "%s has settings out of range\n", arg.c_str() + 5);
+          return 1;
+        }
+      }else if(!applySetting(snapshot, arg)){
+        fprintf(stderr, "Invalid setting %s\n", argv[i]);
+        return 1;
+      }
+    }
+    return writeSnapshot(argv[2], snapshot) ? 0 : 1;
+  }
+
+  fprintf(stderr, "Usage:\n  %s show <file>\n  %s diff <file1> <file2>\n  %s generate <out> [base=<file>] [key=value...]\n", argv[0], argv[0], argv[0]);
+  return 1;
+}
@@ -0,0 +1,190 @@
+/*
+
+  Host test of the SNTP server (include/sntpserver.h) against a local NTP client
+
+  Build: g++ -std=c++11 -Iinclude -Itools/host -o sntp_throughput tools/sntp_throughput.cpp
+
+  sntp_throughput [rounds] [clients per round]
+
+  The server runs on port 12300 on the UDP and WiFi stand-ins of tools/host, with the time
+  of the computer. Every round (20 of 100 clients if not given) each client sends a request
+  from its own loopback address, 127.x.y.z, so the rate limit doesn't drop it, then the
+  server loop runs until it read them all and the answers are checked: server mode, stratum,
+  reference id, originate timestamp of the request and transmit time within 5 ms of the
+  computer clock. Half the rounds have an upstream address and half report "LOCL". At the
+  end a client asks twice in a row and the second request must be dropped.
+  Prints the requests answered per second of server loop and exits with 1 if a check fails.
+
+*/
+
+#define SNTP_PORT 12300
+
+#include <stdlib.h>
+#include <time.h>
+#include <poll.h>
+#include <vector>
+
+#include "sntpserver.h"
+
+#define UPSTREAM IPAddress(192, 0, 2, 123)
+
+uint32_t referenceAddress = 0;
+int failures = 0;
+
+void check(bool condition, const char* what){
+  if(!condition){
+    printf("FAIL %s\n", what);
+    failures++;
+  }
+}
+
+uint64_t realMillis(){
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+// millis() of the stand-in follows the monotonic clock, for the rate limit
+void updateMicros(){
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  hostMicros = now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+}
+
+double elapsedMicros(const timespec& start){
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) * 1e6 + (now.tv_nsec - start.tv_nsec) / 1e3;
+}
+
+bool getClock(SntpClock& clock){
+  uint64_t now = realMillis();
+  clock.seconds = now / 1000;
+  clock.millis = now % 1000;
+  clock.referenceSeconds = clock.seconds - 60;
+  clock.referenceAddress = referenceAddress;
+  clock.stratum = 3;
+  return true;
+}
+
+int openClient(uint32_t address){
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(address);
+  if(bind(fd, (sockaddr*)&local, sizeof(local)) != 0){
+    perror("bind to a loopback address");
+    exit(2);
+  }
+  return fd;
+}
+
+void sendRequest(int fd, uint8_t* request){
+  memset(request, 0, SNTP_PACKET_L);
+  request[0] = 0x23;      // Version 4, client mode
+  uint64_t now = realMillis();
+  sntpWriteTimestamp(request + 40, now / 1000, now % 1000);
+  request[47] = rand();   // So every originate timestamp is different
+  sockaddr_in server = {};
+  server.sin_family = AF_INET;
+  server.sin_port = htons(SNTP_PORT);
+  server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sendto(fd, request, SNTP_PACKET_L, 0, (sockaddr*)&server, sizeof(server));
+}
+
+// Runs the server until it read count more requests, returns the microseconds spent in it
+double serve(unsigned long count){
+  unsigned long target = sntpRequests + count;
+  double busy = 0;
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while(sntpRequests < target && elapsedMicros(deadline) < 2e6){
+    updateMicros();
+    timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    loopSntpServer();
+    busy += elapsedMicros(start);
+  }
+  return busy;
+}
+
+bool receiveAnswer(int fd, uint8_t* answer, int timeout){
+  pollfd p = { fd, POLLIN, 0 };
+  return poll(&p, 1, timeout) > 0 && recv(fd, answer, SNTP_PACKET_L + 1, 0) == SNTP_PACKET_L;
+}
+
+// Unix milliseconds of an NTP timestamp
+uint64_t readUnixMillis(const uint8_t* p){
+  uint32_t seconds = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+  uint32_t fraction = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+  return (uint64_t)(seconds - SNTP_UNIX_OFFSET) * 1000 + (((uint64_t)fraction * 1000) >> 32);
+}
+
+void checkAnswer(const uint8_t* request, const uint8_t* answer){
+  check((answer[0] & 0x07) == 4 && ((answer[0] >> 3) & 0x07) == 4, "Server mode and version of the request");
+  check(answer[1] == 3, "Stratum");
+  if(referenceAddress){
+    check(memcmp(answer + 12, "\xC0\x00\x02\x7B", 4) == 0, "Reference id is the upstream address");
+  }else{
+    check(memcmp(answer + 12, "LOCL", 4) == 0, "Reference id is LOCL without upstream");
+  }
+  check(memcmp(answer + 24, request + 40, 8) == 0, "Originate timestamp of the request");
+  long long offset = (long long)readUnixMillis(answer + 40) - (long long)realMillis();
+  check(offset > -5 && offset <= 5, "Transmit time matches the computer clock");
+}
+
+int main(int argc, char** argv){
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  int rounds = argc >= 2 ? atoi(argv[1]) : 20;
+  int clients = argc >= 3 ? atoi(argv[2]) : 100;
+  if(rounds < 1 || clients < 1 || clients > 500){
+    fprintf(stderr, "Usage: sntp_throughput [rounds] [clients per round, up to 500]\n");
+    return 1;
+  }
+
+  setupSntpServer(getClock);
+  updateMicros();
+  loopSntpServer();
+  if(!sntpStarted){
+    fprintf(stderr, "Can't listen on port %d\n", SNTP_PORT);
+    return 2;
+  }
+
+  double busy = 0;
+  unsigned long answered = 0;
+  uint32_t nextAddress = 0x7F010001;    // 127.1.0.1
+  std::vector<int> fds(clients);
+  std::vector<uint8_t> requests(clients * SNTP_PACKET_L);
+  for(int r = 0; r < rounds; r++){
+    referenceAddress = r % 2 ? 0 : (uint32_t)UPSTREAM;
+    for(int c = 0; c < clients; c++){
+      fds[c] = openClient(nextAddress++);
+      sendRequest(fds[c], &requests[c * SNTP_PACKET_L]);
+    }
+    busy += serve(clients);
+    for(int c = 0; c < clients; c++){
+      uint8_t answer[SNTP_PACKET_L + 1];
+      if(receiveAnswer(fds[c], answer, 500)){
+        checkAnswer(&requests[c * SNTP_PACKET_L], answer);
+        answered++;
+      }
+      close(fds[c]);
+    }
+  }
+  check(answered == (unsigned long)rounds * clients, "Every request answered");
+
+  // The same client twice in a row
+  int fd = openClient(nextAddress);
+  uint8_t request[SNTP_PACKET_L];
+  uint8_t answer[SNTP_PACKET_L + 1];
+  unsigned long dropped = sntpDropped;
+  sendRequest(fd, request);
+  sendRequest(fd, request);
+  serve(2);
+  check(receiveAnswer(fd, answer, 500) && !receiveAnswer(fd, answer, 100) && sntpDropped == dropped + 1, "A client asking again before SNTP_MIN_INTERVAL is dropped");
+  close(fd);
+
+  printf("%lu requests answered, %.1f us each in the server loop, %.0f answers/s\n", answered, busy / answered, answered / busy * 1e6);
+  printf(failures ? "%d checks failed\n" : "All checks passed\n", failures);
+  return failures ? 1 : 0;
+}
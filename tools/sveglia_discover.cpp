@@ -0,0 +1,235 @@
+/*
+
+  Host tool to list the clocks of the network with their state, from the DNS-SD records
+  they advertise (include/discovery.h)
+
+  Build: g++ -std=c++11 -o sveglia_discover tools/sveglia_discover.cpp
+
+  sveglia_discover [-t seconds] [-s address[:port]]
+
+  Sends one query for _sveglia._tcp.local to the mDNS multicast group, or to the address given
+  with -s, and prints what arrives in the next seconds (2 if not given). The query comes from a
+  port other than 5353, so the clocks answer directly to the tool with the service, its TXT
+  record and their address in the same packet.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MDNS_ADDRESS "224.0.0.251"
+#define MDNS_PORT 5353
+#define SERVICE "_sveglia._tcp.local"
+#define TYPE_A 1
+#define TYPE_PTR 12
+#define TYPE_TXT 16
+#define TYPE_SRV 33
+
+struct Clock {
+  std::string host;
+  uint16_t port = 0;
+  std::string address;
+  std::map<std::string, std::string> txt;
+};
+
+std::map<std::string, Clock> clocks;
+std::map<std::string, std::string> hostAddresses;
+
+// Reads a name with compression pointers, returns the offset after it, 0 if it's malformed
+size_t readName(const uint8_t* packet, size_t length, size_t offset, std::string& name){
+  name.clear();
+  size_t end = 0;
+  int jumps = 0;
+  while(offset < length){
+    uint8_t label = packet[offset];
+    if(label == 0){
+      return end ? end : offset + 1;
+    }
+    if((label & 0xC0) == 0xC0){
+      if(offset + 1 >= length || ++jumps > 16){
+        return 0;
+      }
+      if(!end){
+        end = offset + 2;
+      }
+      offset = ((label & 0x3F) << 8) | packet[offset + 1];
+      continue;
+    }
+    if(offset + 1 + label > length){
+      return 0;
+    }
+    if(!name.empty()){
+      name += '.';
+    }
+    name.append((const char*)packet + offset + 1, label);
+    offset += 1 + label;
+  }
+  return 0;
+}
+
+uint16_t read16(const uint8_t* p){
+  return (p[0] << 8) | p[1];
+}
+
+bool sameName(const std::string& a, const std::string& b){
+  return strcasecmp(a.c_str(), b.c_str()) == 0;
+}
+
+void parseResponse(const uint8_t* packet, size_t length, const char* source){
+  if(length < 12 || !(packet[2] & 0x80)){
+    return;     // Not a response
+  }
+  int questions = read16(packet + 4);
+  int records = read16(packet + 6) + read16(packet + 8) + read16(packet + 10);
+  size_t offset = 12;
+  std::string name;
+  for(int i = 0; i < questions; i++){
+    offset = readName(packet, length, offset, name);
+    if(!offset || offset + 4 > length){
+      return;
+    }
+    offset += 4;
+  }
+
+  for(int i = 0; i < records; i++){
+    offset = readName(packet, length, offset, name);
+    if(!offset || offset + 10 > length){
+      return;
+    }
+    uint16_t type = read16(packet + offset);
+    uint16_t dataLength = read16(packet + offset + 8);
+    size_t data = offset + 10;
+    offset = data + dataLength;
+    if(offset > length){
+      return;
+    }
+
+    std::string target;
+    if(type == TYPE_PTR && sameName(name, SERVICE) && readName(packet, length, data, target)){
+      clocks[target].address = source;
+    }else if(type == TYPE_SRV && dataLength >= 6 && readName(packet, length, data + 6, target)){
+      clocks[name].port = read16(packet + data + 4);
+      clocks[name].host = target;
+    }else if(type == TYPE_TXT){
+      Clock& clock = clocks[name];
+      for(size_t p = data; p < offset && p + 1 + packet[p] <= offset; p += 1 + packet[p]){
+        std::string item((const char*)packet + p + 1, packet[p]);
+        size_t equal = item.find('=');
+        if(equal != std::string::npos){
+          clock.txt[item.substr(0, equal)] = item.substr(equal + 1);
+        }
+      }
+    }else if(type == TYPE_A && dataLength == 4){
+      char address[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, packet + data, address, sizeof(address));
+      hostAddresses[name] = address;
+    }
+  }
+}
+
+size_t buildQuery(uint8_t* packet){
+  memset(packet, 0, 12);
+  packet[5] = 1;      // One question
+  size_t offset = 12;
+  const char* label = SERVICE;
+  while(*label){
+    size_t length = strcspn(label, ".");
+    packet[offset++] = length;
+    memcpy(packet + offset, label, length);
+    offset += length;
+    label += length + (label[length] == '.');
+  }
+  packet[offset++] = 0;
+  packet[offset++] = 0;
+  packet[offset++] = TYPE_PTR;
+  packet[offset++] = 0x80;    // Unicast response
+  packet[offset++] = 1;
+  return offset;
+}
+
+long long nowMillis(){
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+int main(int argc, char** argv){
+  double seconds = 2;
+  std::string server = MDNS_ADDRESS;
+  int port = MDNS_PORT;
+  int option;
+  while((option = getopt(argc, argv, "t:s:")) != -1){
+    if(option == 't'){
+      seconds = atof(optarg);
+    }else if(option == 's'){
+      server = optarg;
+      size_t colon = server.find(':');
+      if(colon != std::string::npos){
+        port = atoi(server.c_str() + colon + 1);
+        server.resize(colon);
+      }
+    }else{
+      fprintf(stderr, "Usage: sveglia_discover [-t seconds] [-s address[:port]]\n");
+      return 1;
+    }
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in destination = {};
+  destination.sin_family = AF_INET;
+  destination.sin_port = htons(port);
+  if(inet_pton(AF_INET, server.c_str(), &destination.sin_addr) != 1){
+    fprintf(stderr, "%s is not an IPv4 address\n", server.c_str());
+    return 1;
+  }
+  uint8_t packet[9000];
+  size_t length = buildQuery(packet);
+  if(sendto(fd, packet, length, 0, (sockaddr*)&destination, sizeof(destination)) < 0){
+    perror("sendto");
+    return 1;
+  }
+
+  long long end = nowMillis() + (long long)(seconds * 1000);
+  while(nowMillis() < end){
+    pollfd p = { fd, POLLIN, 0 };
+    if(poll(&p, 1, end - nowMillis()) <= 0){
+      continue;
+    }
+    sockaddr_in source;
+    socklen_t sourceLength = sizeof(source);
+    ssize_t received = recvfrom(fd, packet, sizeof(packet), 0, (sockaddr*)&source, &sourceLength);
+    if(received > 0){
+      char address[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &source.sin_addr, address, sizeof(address));
+      parseResponse(packet, received, address);
+    }
+  }
+
+  printf("%-18s %-28s %-16s %-21s %-7s %-5s %s\n", "Instance", "Host", "Address", "Next alarm", "Sync", "Cfg", "Firmware");
+  int count = 0;
+  for(auto& entry : clocks){
+    Clock& clock = entry.second;
+    if(clock.address.empty()){
+      continue;     // Records of a service that didn't answer the query
+    }
+    std::string instance = entry.first.substr(0, entry.first.find('.'));
+    auto known = hostAddresses.find(clock.host);
+    std::string address = known != hostAddresses.end() ? known->second : clock.address;
+    printf("%-18s %-28s %-16s %-21s %-7s %-5s %s\n", instance.c_str(), clock.host.empty() ? "?" : clock.host.c_str(),
+           address.c_str(), clock.txt.count("next") ? clock.txt["next"].c_str() : "?", clock.txt.count("sync") ? clock.txt["sync"].c_str() : "?",
+           clock.txt.count("cfg") ? clock.txt["cfg"].c_str() : "?", clock.txt.count("fw") ? clock.txt["fw"].c_str() : "?");
+    count++;
+  }
+  printf("%d clocks\n", count);
+  return 0;
+}
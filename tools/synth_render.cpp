@@ -0,0 +1,103 @@
+/*
+
+  Host tool to listen to the alarm sounds and measure the cost of the synthesizer.
+  It uses the same code as the firmware (include/synth.h and include/melodies.h).
+
+  Build: g++ -std=c++11 -O2 -Iinclude -o synth_render tools/synth_render.cpp
+
+  synth_render wav <alarm> <out.wav> [seconds]    Renders the alarm with its volume ramp (default 10s)
+  synth_render bench                              Prints the nanoseconds per sample of every alarm
+
+  Alarms: 0-5, in the order of the alarm sound menu
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "melodies.h"
+
+#define RENDER_CHUNK 64
+
+// Plays the melody again and again like the firmware does until the alarm is dismissed
+void renderAlarm(Synth& synth, const SynthMelody& melody, int16_t* out, size_t count){
+  for(size_t i = 0; i < count; i += RENDER_CHUNK){
+    if(!synth.isPlaying()){
+      synth.play(melody);
+    }
+    size_t length = count - i < RENDER_CHUNK ? count - i : RENDER_CHUNK;
+    synth.render(out + i, length);
+  }
+}
+
+void writeLE(FILE* f, uint32_t value, int bytes){
+  for(int i = 0; i < bytes; i++){
+    fputc((value >> (i * 8)) & 0xFF, f);
+  }
+}
+
+bool writeWav(const char* path, const std::vector<int16_t>& samples){
+  FILE* f = fopen(path, "wb");
+  if(!f){
+    return false;
+  }
+  uint32_t dataLength = samples.size() * 2;
+  fwrite("RIFF", 1, 4, f);
+  writeLE(f, 36 + dataLength, 4);
+  fwrite("WAVEfmt ", 1, 8, f);
+  writeLE(f, 16, 4);
+  writeLE(f, 1, 2);                       // PCM
+  writeLE(f, 1, 2);                       // Mono
+  writeLE(f, SYNTH_SAMPLE_RATE, 4);
+  writeLE(f, SYNTH_SAMPLE_RATE * 2, 4);
+  writeLE(f, 2, 2);
+  writeLE(f, 16, 2);
+  fwrite("data", 1, 4, f);
+  writeLE(f, dataLength, 4);
+  for(int16_t sample : samples){
+    writeLE(f, (uint16_t)sample, 2);
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char** argv){
+  if(argc >= 4 && strcmp(argv[1], "wav") == 0){
+    unsigned int alarm = atoi(argv[2]);
+    int seconds = argc >= 5 ? atoi(argv[4]) : 10;
+    if(alarm >= ALARM_MELODIES || seconds <= 0){
+      fprintf(stderr, "Invalid alarm or duration\n");
+      return 1;
+    }
+    Synth synth;
+    synth.setGainRamp(ALARM_GAIN_START, 255, ALARM_RAMP_MILLIS);
+    std::vector<int16_t> samples(SYNTH_SAMPLE_RATE * seconds);
+    renderAlarm(synth, *alarmMelodies[alarm], samples.data(), samples.size());
+    if(!writeWav(argv[3], samples)){
+      fprintf(stderr, "Can't write %s\n", argv[3]);
+      return 1;
+    }
+    return 0;
+  }
+
+  if(argc == 2 && strcmp(argv[1], "bench") == 0){
+    const size_t count = SYNTH_SAMPLE_RATE * 60;
+    std::vector<int16_t> samples(count);
+    for(unsigned int alarm = 0; alarm < ALARM_MELODIES; alarm++){
+      Synth synth;
+      synth.setGainRamp(ALARM_GAIN_START, 255, ALARM_RAMP_MILLIS);
+      auto start = std::chrono::steady_clock::now();
+      renderAlarm(synth, *alarmMelodies[alarm], samples.data(), count);
+      auto end = std::chrono::steady_clock::now();
+      double nanos = std::chrono::duration<double, std::nano>(end - start).count();
+      printf("Alarm %u: %.2f ns/sample\n", alarm, nanos / count);
+    }
+    return 0;
+  }
+
+  fprintf(stderr, "Usage:\n  synth_render wav <alarm> <out.wav> [seconds]\n  synth_render bench\n");
+  return 1;
+}